@@ -0,0 +1,51 @@
+#!/bin/sh
+# Starts or stops a throwaway redis-server with the module loaded.
+#
+#   server.sh start <port> <module.so> [wrapper ...]
+#   server.sh stop <port>
+#
+# The server runs without persistence from a temporary directory. Anything
+# after the module path is prepended to the server command line, which is
+# how `make memcheck` runs it under valgrind.
+
+set -e
+
+REDIS_SERVER=${REDIS_SERVER:-redis-server}
+REDIS_CLI=${REDIS_CLI:-redis-cli}
+
+cmd=$1
+port=$2
+dir=${TMPDIR:-/tmp}/cacheguard-$port
+
+case "$cmd" in
+start)
+    module=$(cd "$(dirname "$3")" && pwd)/$(basename "$3")
+    shift 3
+    rm -rf "$dir"
+    mkdir -p "$dir"
+    "$@" "$REDIS_SERVER" --port "$port" --dir "$dir" --save "" --appendonly no \
+        --loadmodule "$module" --logfile "$dir/redis.log" >"$dir/stdout.log" 2>&1 &
+    echo $! >"$dir/pid"
+    # Valgrind startup can take several seconds
+    tries=0
+    until "$REDIS_CLI" -p "$port" ping >/dev/null 2>&1; do
+        tries=$((tries + 1))
+        if [ $tries -gt 100 ] || ! kill -0 "$(cat "$dir/pid")" 2>/dev/null; then
+            echo "redis-server failed to start, see $dir/redis.log" >&2
+            exit 1
+        fi
+        sleep 0.2
+    done
+    ;;
+stop)
+    "$REDIS_CLI" -p "$port" shutdown nosave >/dev/null 2>&1 || true
+    pid=$(cat "$dir/pid" 2>/dev/null || true)
+    while [ -n "$pid" ] && kill -0 "$pid" 2>/dev/null; do
+        sleep 0.1
+    done
+    ;;
+*)
+    echo "usage: $0 start <port> <module.so> [wrapper ...] | stop <port>" >&2
+    exit 1
+    ;;
+esac
@@ -0,0 +1,838 @@
+// Stampede benchmark for the Cache Guard module.
+//
+// Runs N concurrent clients against a redis-server. Each client reads keys
+// with Zipfian popularity and regenerates misses through a simulated slow
+// backend. The same workload runs twice: once with plain GET/SET and once
+// with cache.guard.get/cache.guard.set. The benchmark reports throughput,
+// end-to-end read latency (including any regeneration the client performed)
+// and backend regenerations per expiry. With --repl-bytes it also reports
+// how many bytes each read added to the AOF, which is the same command stream
+// replicas receive.
+//
+// With --hits every client instead reads one value that never expires, so
+// every read is a fresh hit. This isolates the hit path for large values:
+// the report has reads per second, latency and the server's allocations per
+// read, plus the latency of writing the value, which shows how long
+// compression holds the event loop.
+//
+// Talks RESP directly over TCP so the only dependency is pthreads.
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <math.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define READ_BUF_SIZE (64 * 1024)
+
+// Same log-linear bucket layout as the module's latency histograms
+#define HIST_SUB_BITS 4
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS 30
+#define HIST_MAX_US ((1LL << HIST_MAX_BITS) - 1)
+#define HIST_BUCKETS ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS)
+
+typedef enum { MODE_PLAIN = 0, MODE_GUARDED } BenchMode;
+
+static const char *ModeNames[] = { "plain", "guarded" };
+
+// Command line options
+static struct {
+    const char *host;
+    int port;
+    int clients;
+    int keys;
+    double zipf;
+    int duration;           // Seconds per mode
+    long long ttl;          // Value TTL, ms
+    long long grace;        // Grace period for cache.guard.get, ms
+    long long backend;      // Simulated backend latency, ms
+    size_t valueSize;
+    int modes;              // Bit mask of BenchMode
+    int lockMiss;
+    int xfetch;
+    int replBytes;          // Enable AOF and report bytes written per read
+    int hits;               // Fresh hits on one value instead of the stampede
+    long long compress;     // compress_threshold for the guarded run (-1 = leave as is)
+    int raw;                // Pass RAW to cache.guard.get (--hits)
+} opts = {
+    .host = "127.0.0.1",
+    .port = 6379,
+    .clients = 50,
+    .keys = 1000,
+    .zipf = 0.99,
+    .duration = 10,
+    .ttl = 2000,
+    .grace = 500,
+    .backend = 50,
+    .valueSize = 256,
+    .modes = (1 << MODE_PLAIN) | (1 << MODE_GUARDED),
+    .lockMiss = 0,
+    .xfetch = 0,
+    .replBytes = 0,
+    .hits = 0,
+    .compress = -1,
+    .raw = 0
+};
+
+// TTL of the --hits value: long enough that no read reaches the grace window
+#define HIT_TTL_MS "3600000"
+#define HIT_KEY "bench:hit"
+#define HIT_WRITES 100          // Timed writes of the --hits value before the reads
+
+typedef struct Histogram {
+    unsigned long long count;
+    long long max;
+    unsigned long long buckets[HIST_BUCKETS];
+} Histogram;
+
+// Result of one run, merged from every client
+typedef struct RunStats {
+    unsigned long long reads;
+    unsigned long long busyRetries;     // BUSYREGEN replies (LOCKMISS)
+    unsigned long long errors;
+    Histogram latency;
+} RunStats;
+
+typedef struct Client {
+    int fd;
+    char *rbuf;
+    size_t rlen, rpos;
+    uint64_t rng;
+    BenchMode mode;
+    RunStats stats;
+    pthread_t thread;
+} Client;
+
+// Shared state for one run
+static double *zipfCdf;
+static long long *lastRegenAt;          // Per key, ms; detects regeneration episodes
+static unsigned long long regenerations;
+static unsigned long long episodes;
+static volatile int running;
+static char *benchValue;
+
+static long long NowMicros(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static void SleepMillis(long long ms) {
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {
+    }
+}
+
+static uint64_t NextRandom(uint64_t *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+static void Die(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+    exit(1);
+}
+
+/* ------------------------------- Histogram ------------------------------- */
+
+static int HistIndex(long long v) {
+    if (v < HIST_SUB_BUCKETS) {
+        return v < 0 ? 0 : (int)v;
+    }
+    if (v > HIST_MAX_US) {
+        v = HIST_MAX_US;
+    }
+    int shift = 63 - __builtin_clzll((unsigned long long)v) - HIST_SUB_BITS;
+    return (shift + 1) * HIST_SUB_BUCKETS + (int)((v >> shift) - HIST_SUB_BUCKETS);
+}
+
+static long long HistUpper(int idx) {
+    if (idx < HIST_SUB_BUCKETS) {
+        return idx;
+    }
+    int shift = idx / HIST_SUB_BUCKETS - 1;
+    long long lower = (long long)(idx % HIST_SUB_BUCKETS + HIST_SUB_BUCKETS) << shift;
+    return lower + (1LL << shift) - 1;
+}
+
+static void HistRecord(Histogram *h, long long v) {
+    h->buckets[HistIndex(v)]++;
+    h->count++;
+    if (v > h->max) {
+        h->max = v;
+    }
+}
+
+static void HistMerge(Histogram *dst, const Histogram *src) {
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        dst->buckets[i] += src->buckets[i];
+    }
+    dst->count += src->count;
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+}
+
+static long long HistPercentile(const Histogram *h, double pct) {
+    if (h->count == 0) {
+        return 0;
+    }
+    unsigned long long rank = (unsigned long long)ceil(h->count * pct / 100.0);
+    unsigned long long seen = 0;
+    if (rank == 0) rank = 1;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            long long upper = HistUpper(i);
+            return upper < h->max ? upper : h->max;
+        }
+    }
+    return h->max;
+}
+
+/* --------------------------------- RESP ---------------------------------- */
+
+typedef enum { REPLY_STATUS, REPLY_ERROR, REPLY_INTEGER, REPLY_BULK, REPLY_NIL, REPLY_ARRAY } ReplyType;
+
+// Only the fields the benchmark looks at. Bulk payloads are skipped unless
+// the caller provides a buffer in data/cap.
+typedef struct Reply {
+    ReplyType type;
+    long long integer;
+    char text[256];         // Status or error line
+    char *data;             // Optional bulk payload buffer (NUL-terminated)
+    size_t cap;
+} Reply;
+
+static int Connect(const char *host, int port) {
+    char portStr[16];
+    struct addrinfo hints = { 0 }, *res, *ai;
+    int fd = -1;
+
+    snprintf(portStr, sizeof(portStr), "%d", port);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, portStr, &hints, &res) != 0) {
+        return -1;
+    }
+    for (ai = res; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd == -1) continue;
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd != -1) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+static int WriteAll(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Sends one command. Arguments are C strings except the one at bulkIdx,
+// which is sent from bulk/bulkLen (the benchmark value).
+static int SendCommand(Client *c, int argc, const char **argv, int bulkIdx,
+                       const char *bulk, size_t bulkLen) {
+    char head[1024];
+    size_t len = snprintf(head, sizeof(head), "*%d\r\n", argc);
+    for (int i = 0; i < argc; i++) {
+        const char *arg = i == bulkIdx ? bulk : argv[i];
+        size_t argLen = i == bulkIdx ? bulkLen : strlen(argv[i]);
+        len += snprintf(head + len, sizeof(head) - len, "$%zu\r\n", argLen);
+        if (i == bulkIdx) {
+            if (WriteAll(c->fd, head, len) || WriteAll(c->fd, arg, argLen)) return -1;
+            len = snprintf(head, sizeof(head), "\r\n");
+        } else {
+            if (len + argLen + 2 >= sizeof(head)) return -1;
+            memcpy(head + len, arg, argLen);
+            len += argLen;
+            memcpy(head + len, "\r\n", 2);
+            len += 2;
+        }
+    }
+    return WriteAll(c->fd, head, len);
+}
+
+static int FillBuffer(Client *c) {
+    if (c->rpos > 0) {
+        memmove(c->rbuf, c->rbuf + c->rpos, c->rlen - c->rpos);
+        c->rlen -= c->rpos;
+        c->rpos = 0;
+    }
+    if (c->rlen == READ_BUF_SIZE) {
+        return -1;
+    }
+    ssize_t n;
+    do {
+        n = read(c->fd, c->rbuf + c->rlen, READ_BUF_SIZE - c->rlen);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        return -1;
+    }
+    c->rlen += n;
+    return 0;
+}
+
+// Reads one CRLF-terminated line, without the terminator
+static int ReadLine(Client *c, char *out, size_t outSize) {
+    for (;;) {
+        char *start = c->rbuf + c->rpos;
+        char *nl = memchr(start, '\n', c->rlen - c->rpos);
+        if (nl) {
+            size_t len = nl - start;
+            if (len > 0 && start[len - 1] == '\r') len--;
+            if (len >= outSize) len = outSize - 1;
+            memcpy(out, start, len);
+            out[len] = '\0';
+            c->rpos = nl - c->rbuf + 1;
+            return 0;
+        }
+        if (FillBuffer(c)) return -1;
+    }
+}
+
+static int SkipBytes(Client *c, size_t n) {
+    while (n > 0) {
+        if (c->rpos == c->rlen && FillBuffer(c)) return -1;
+        size_t avail = c->rlen - c->rpos;
+        size_t take = avail < n ? avail : n;
+        c->rpos += take;
+        n -= take;
+    }
+    return 0;
+}
+
+static int ReadReply(Client *c, Reply *r) {
+    char line[256];
+    if (ReadLine(c, line, sizeof(line))) return -1;
+
+    switch (line[0]) {
+    case '+':
+        r->type = REPLY_STATUS;
+        snprintf(r->text, sizeof(r->text), "%s", line + 1);
+        return 0;
+    case '-':
+        r->type = REPLY_ERROR;
+        snprintf(r->text, sizeof(r->text), "%s", line + 1);
+        return 0;
+    case ':':
+        r->type = REPLY_INTEGER;
+        r->integer = strtoll(line + 1, NULL, 10);
+        return 0;
+    case '$': {
+        long long len = strtoll(line + 1, NULL, 10);
+        if (len < 0) {
+            r->type = REPLY_NIL;
+            return 0;
+        }
+        r->type = REPLY_BULK;
+        r->integer = len;
+        if (r->data && (size_t)len < r->cap) {
+            // Copied piecewise: the payload may not fit the read buffer
+            for (size_t got = 0; got < (size_t)len; ) {
+                if (c->rpos == c->rlen && FillBuffer(c)) return -1;
+                size_t avail = c->rlen - c->rpos;
+                size_t take = avail < (size_t)len - got ? avail : (size_t)len - got;
+                memcpy(r->data + got, c->rbuf + c->rpos, take);
+                c->rpos += take;
+                got += take;
+            }
+            r->data[len] = '\0';
+            return SkipBytes(c, 2);
+        }
+        return SkipBytes(c, (size_t)len + 2);
+    }
+    case '*': {
+        long long n = strtoll(line + 1, NULL, 10);
+        Reply elem = { .data = NULL };
+        r->type = n < 0 ? REPLY_NIL : REPLY_ARRAY;
+        r->integer = n;
+        for (long long i = 0; i < n; i++) {
+            if (ReadReply(c, &elem)) return -1;
+        }
+        return 0;
+    }
+    default:
+        return -1;
+    }
+}
+
+static int Command(Client *c, Reply *r, int argc, const char **argv) {
+    if (SendCommand(c, argc, argv, -1, NULL, 0)) return -1;
+    return ReadReply(c, r);
+}
+
+/* ------------------------------- Workload -------------------------------- */
+
+static void BuildZipf(void) {
+    zipfCdf = malloc(sizeof(double) * opts.keys);
+    double sum = 0;
+    for (int i = 0; i < opts.keys; i++) {
+        sum += 1.0 / pow(i + 1, opts.zipf);
+        zipfCdf[i] = sum;
+    }
+    for (int i = 0; i < opts.keys; i++) {
+        zipfCdf[i] /= sum;
+    }
+}
+
+static int PickKey(Client *c) {
+    double u = (NextRandom(&c->rng) >> 11) * (1.0 / 9007199254740992.0);
+    int lo = 0, hi = opts.keys - 1;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (zipfCdf[mid] < u) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// The simulated backend. Regenerations of the same key closer together
+// than half a TTL belong to one expiry episode; a perfect guard makes
+// exactly one regeneration per episode.
+static void Regenerate(int key) {
+    long long now = NowMicros() / 1000;
+    long long prev = __atomic_exchange_n(&lastRegenAt[key], now, __ATOMIC_RELAXED);
+    if (now - prev > opts.ttl / 2) {
+        __atomic_add_fetch(&episodes, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_add_fetch(&regenerations, 1, __ATOMIC_RELAXED);
+    SleepMillis(opts.backend);
+}
+
+// One read as an application would do it: read, and on a miss regenerate
+// and write back. Returns -1 on connection errors.
+static int ReadThrough(Client *c, int key) {
+    char keyName[32], ttl[32], grace[32];
+    Reply r;
+    snprintf(keyName, sizeof(keyName), "bench:%d", key);
+    snprintf(ttl, sizeof(ttl), "%lld", opts.ttl);
+    snprintf(grace, sizeof(grace), "%lld", opts.grace);
+
+    if (c->mode == MODE_PLAIN) {
+        const char *get[] = { "GET", keyName };
+        if (Command(c, &r, 2, get)) return -1;
+        if (r.type == REPLY_BULK) return 0;
+
+        Regenerate(key);
+        const char *set[] = { "SET", keyName, NULL, "PX", ttl };
+        if (SendCommand(c, 5, set, 2, benchValue, opts.valueSize) || ReadReply(c, &r)) return -1;
+        if (r.type == REPLY_ERROR) c->stats.errors++;
+        return 0;
+    }
+
+    for (;;) {
+        const char *get[5] = { "cache.guard.get", keyName, grace };
+        int argc = 3;
+        if (opts.lockMiss) get[argc++] = "LOCKMISS";
+        if (opts.xfetch) get[argc++] = "XFETCH";
+        if (Command(c, &r, argc, get)) return -1;
+
+        if (r.type == REPLY_BULK) return 0;
+        if (r.type == REPLY_ERROR && strncmp(r.text, "BUSYREGEN", 9) == 0) {
+            // "BUSYREGEN ... retry after N ms"
+            const char *after = strstr(r.text, "after ");
+            long long wait = after ? strtoll(after + 6, NULL, 10) : 1;
+            c->stats.busyRetries++;
+            SleepMillis(wait < 1 ? 1 : wait > opts.backend ? opts.backend : wait);
+            continue;
+        }
+        if (r.type == REPLY_ERROR) {
+            c->stats.errors++;
+            return 0;
+        }
+        break;
+    }
+
+    Regenerate(key);
+    const char *set[] = { "cache.guard.set", keyName, NULL, ttl };
+    if (SendCommand(c, 4, set, 2, benchValue, opts.valueSize) || ReadReply(c, &r)) return -1;
+    if (r.type == REPLY_ERROR) c->stats.errors++;
+    return 0;
+}
+
+// One --hits read. Anything but the value counts as an error.
+static int ReadHit(Client *c) {
+    char grace[32];
+    Reply r;
+    snprintf(grace, sizeof(grace), "%lld", opts.grace);
+    const char *plain[] = { "GET", HIT_KEY };
+    const char *guarded[] = { "cache.guard.get", HIT_KEY, grace, "RAW" };
+    if (c->mode == MODE_PLAIN ? Command(c, &r, 2, plain) :
+                                Command(c, &r, opts.raw ? 4 : 3, guarded)) return -1;
+    // RAW replies carry the stored (possibly compressed) size
+    if (r.type != REPLY_BULK || (!opts.raw && (size_t)r.integer != opts.valueSize)) c->stats.errors++;
+    return 0;
+}
+
+static void *ClientMain(void *arg) {
+    Client *c = arg;
+    while (running) {
+        int key = PickKey(c);
+        long long start = NowMicros();
+        if (opts.hits ? ReadHit(c) : ReadThrough(c, key)) {
+            c->stats.errors++;
+            break;
+        }
+        HistRecord(&c->stats.latency, NowMicros() - start);
+        c->stats.reads++;
+    }
+    return NULL;
+}
+
+static Client *AdminConnect(void) {
+    Client *c = calloc(1, sizeof(Client));
+    c->rbuf = malloc(READ_BUF_SIZE);
+    c->fd = Connect(opts.host, opts.port);
+    if (c->fd == -1) {
+        Die("cannot connect to %s:%d", opts.host, opts.port);
+    }
+    return c;
+}
+
+static void AdminClose(Client *c) {
+    close(c->fd);
+    free(c->rbuf);
+    free(c);
+}
+
+// Returns a numeric INFO field, or -1 if the server doesn't report it
+static long long InfoField(Client *c, const char *section, const char *field) {
+    char info[16384];
+    Reply r = { .data = info, .cap = sizeof(info) };
+    const char *argv[] = { "INFO", section };
+    if (Command(c, &r, 2, argv) || r.type != REPLY_BULK || r.integer >= (long long)sizeof(info)) {
+        return -1;
+    }
+    size_t flen = strlen(field);
+    char *line = info;
+    while (line) {
+        if (strncmp(line, field, flen) == 0 && line[flen] == ':') {
+            return strtoll(line + flen + 1, NULL, 10);
+        }
+        line = strchr(line, '\n');
+        if (line) line++;
+    }
+    return -1;
+}
+
+// Allocation requests the server has served so far: the nrequests column of
+// the merged "total:" row of jemalloc's MEMORY MALLOC-STATS. Thread caches
+// report lazily, so this is approximate over a few calls and close over many.
+// Returns -1 with other allocators.
+static long long ServerAllocations(Client *c) {
+    size_t cap = 16 << 20;
+    char *stats = malloc(cap);
+    Reply r = { .data = stats, .cap = cap };
+    const char *argv[] = { "MEMORY", "MALLOC-STATS" };
+    long long n = -1;
+    if (Command(c, &r, 2, argv) || r.type != REPLY_BULK || r.integer >= (long long)cap) {
+        free(stats);
+        return -1;
+    }
+
+    // The column header is the line above the first "small:" row
+    char *small = strstr(stats, "\nsmall:");
+    char *total = small ? strstr(small, "\ntotal:") : NULL;
+    if (total) {
+        char *header = small;
+        while (header > stats && header[-1] != '\n') header--;
+        *small = '\0';
+        int col = -1, i = 0;
+        for (char *tok = strtok(header, " \t"); tok; tok = strtok(NULL, " \t"), i++) {
+            if (strcmp(tok, "nrequests") == 0) {
+                col = i;
+                break;
+            }
+        }
+        char *p = total + strlen("\ntotal:");
+        for (i = 0; col >= 0 && i <= col; i++) {
+            n = strtoll(p, &p, 10);
+        }
+    }
+    free(stats);
+    return n;
+}
+
+// Fills the --hits value with JSON-like records, which LZ4 shrinks about as
+// much as typical cached API responses
+static void FillTextValue(char *buf, size_t len) {
+    uint64_t rng = 0x9E3779B97F4A7C15ULL;
+    size_t pos = 0;
+    while (pos < len) {
+        char rec[160];
+        uint64_t a = NextRandom(&rng), b = NextRandom(&rng);
+        int n = snprintf(rec, sizeof(rec),
+                         "{\"id\":%llu,\"name\":\"item-%llu\",\"price\":%llu.%02llu,"
+                         "\"stock\":%llu,\"tags\":[\"sale\",\"new\"]},",
+                         (unsigned long long)(a % 1000000), (unsigned long long)(b % 100000),
+                         (unsigned long long)(a >> 40) % 1000, (unsigned long long)(b >> 40) % 100,
+                         (unsigned long long)(b >> 20) % 500);
+        size_t take = len - pos < (size_t)n ? len - pos : (size_t)n;
+        memcpy(buf + pos, rec, take);
+        pos += take;
+    }
+}
+
+// Sets compress_threshold before a guarded run when --compress is given
+static void ConfigureCompression(Client *c) {
+    char threshold[32];
+    Reply r;
+    snprintf(threshold, sizeof(threshold), "%lld", opts.compress);
+    const char *argv[] = { "cache.guard.config", "SET", "compress_threshold", threshold };
+    if (Command(c, &r, 4, argv) || r.type == REPLY_ERROR) {
+        Die("cannot set compress_threshold: %s", r.text);
+    }
+}
+
+// Stores the --hits value the way the mode reads it
+static void WriteHitValue(Client *c, BenchMode mode) {
+    Reply r;
+    const char *plain[] = { "SET", HIT_KEY, NULL, "PX", HIT_TTL_MS };
+    const char *guarded[] = { "cache.guard.set", HIT_KEY, NULL, HIT_TTL_MS };
+    if ((mode == MODE_PLAIN ? SendCommand(c, 5, plain, 2, benchValue, opts.valueSize) :
+                              SendCommand(c, 4, guarded, 2, benchValue, opts.valueSize)) ||
+        ReadReply(c, &r) || r.type == REPLY_ERROR) {
+        Die("cannot write %s: %s", HIT_KEY, r.text);
+    }
+}
+
+static void FlushServer(Client *c) {
+    Reply r;
+    const char *flush[] = { "FLUSHALL" };
+    if (Command(c, &r, 1, flush) || r.type == REPLY_ERROR) {
+        Die("cannot flush %s:%d", opts.host, opts.port);
+    }
+}
+
+// Turns on the AOF and waits for the initial rewrite, so that later growth
+// of aof_current_size is the command stream the workload produced
+static void EnableAof(Client *c) {
+    Reply r;
+    const char *argv[] = { "CONFIG", "SET", "appendonly", "yes" };
+    if (Command(c, &r, 4, argv) || r.type == REPLY_ERROR) {
+        Die("cannot enable AOF: %s", r.text);
+    }
+    while (InfoField(c, "persistence", "aof_rewrite_in_progress") != 0 ||
+           InfoField(c, "persistence", "aof_enabled") != 1) {
+        SleepMillis(100);
+    }
+}
+
+// Runs one mode and prints its report line
+static void RunMode(BenchMode mode, Client *admin) {
+    Client *clients = calloc(opts.clients, sizeof(Client));
+    RunStats total = { 0 };
+    long long aofBefore = 0, allocsBefore = 0;
+    Histogram writes = { 0 };
+
+    FlushServer(admin);
+    if (mode == MODE_GUARDED && opts.compress >= 0) {
+        ConfigureCompression(admin);
+    }
+    if (opts.hits) {
+        // One client writing back to back: each write holds the event loop
+        // for its full duration, compression included
+        for (int i = 0; i < HIT_WRITES; i++) {
+            long long writeStart = NowMicros();
+            WriteHitValue(admin, mode);
+            HistRecord(&writes, NowMicros() - writeStart);
+        }
+        allocsBefore = ServerAllocations(admin);
+    }
+    if (opts.replBytes) {
+        aofBefore = InfoField(admin, "persistence", "aof_current_size");
+    }
+    memset(lastRegenAt, 0, sizeof(long long) * opts.keys);
+    regenerations = episodes = 0;
+    running = 1;
+
+    for (int i = 0; i < opts.clients; i++) {
+        Client *c = &clients[i];
+        c->mode = mode;
+        c->rng = 0x9E3779B97F4A7C15ULL * (i + 1) ^ (uint64_t)NowMicros();
+        c->rbuf = malloc(READ_BUF_SIZE);
+        c->fd = Connect(opts.host, opts.port);
+        if (c->fd == -1) {
+            Die("cannot connect to %s:%d", opts.host, opts.port);
+        }
+    }
+
+    long long start = NowMicros();
+    for (int i = 0; i < opts.clients; i++) {
+        pthread_create(&clients[i].thread, NULL, ClientMain, &clients[i]);
+    }
+    SleepMillis(opts.duration * 1000LL);
+    running = 0;
+    for (int i = 0; i < opts.clients; i++) {
+        Client *c = &clients[i];
+        pthread_join(c->thread, NULL);
+        total.reads += c->stats.reads;
+        total.busyRetries += c->stats.busyRetries;
+        total.errors += c->stats.errors;
+        HistMerge(&total.latency, &c->stats.latency);
+        close(c->fd);
+        free(c->rbuf);
+    }
+    double elapsed = (NowMicros() - start) / 1e6;
+    free(clients);
+
+    if (opts.hits) {
+        long long allocsAfter = ServerAllocations(admin);
+        printf("%-8s %12.0f %9lld %9lld %9lld %9lld %7llu %11lld %11lld", ModeNames[mode],
+               total.reads / elapsed, HistPercentile(&total.latency, 50),
+               HistPercentile(&total.latency, 99), HistPercentile(&total.latency, 99.9),
+               total.latency.max, total.errors, HistPercentile(&writes, 50), writes.max);
+        if (allocsBefore >= 0 && allocsAfter >= 0 && total.reads) {
+            printf(" %11.2f\n", (double)(allocsAfter - allocsBefore) / total.reads);
+        } else {
+            printf(" %11s\n", "n/a");
+        }
+        fflush(stdout);
+        return;
+    }
+
+    printf("%-8s %12.0f %9lld %9lld %9lld %9lld %12llu %10.2f %8llu %7llu",
+           ModeNames[mode], total.reads / elapsed,
+           HistPercentile(&total.latency, 50), HistPercentile(&total.latency, 99),
+           HistPercentile(&total.latency, 99.9), total.latency.max,
+           regenerations, episodes ? (double)regenerations / episodes : 0.0,
+           total.busyRetries, total.errors);
+    if (opts.replBytes) {
+        // The AOF is flushed once per event loop; give it a moment
+        SleepMillis(200);
+        long long aofAfter = InfoField(admin, "persistence", "aof_current_size");
+        printf(" %11.1f", total.reads ? (double)(aofAfter - aofBefore) / total.reads : 0.0);
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+static void Usage(void) {
+    fprintf(stderr,
+        "Usage: stampede [options]\n"
+        "  --host <host>         Server host (default 127.0.0.1)\n"
+        "  --port <port>         Server port (default 6379)\n"
+        "  --clients <n>         Concurrent clients (default 50)\n"
+        "  --keys <n>            Key space size (default 1000)\n"
+        "  --zipf <s>            Zipf exponent of key popularity (default 0.99)\n"
+        "  --duration <sec>      Seconds per mode (default 10)\n"
+        "  --ttl <ms>            Value TTL (default 2000)\n"
+        "  --grace <ms>          Grace period for cache.guard.get (default 500)\n"
+        "  --backend <ms>        Simulated backend latency (default 50)\n"
+        "  --value-size <bytes>  Value size (default 256)\n"
+        "  --mode <plain|guarded|both>\n"
+        "  --lockmiss            Pass LOCKMISS to cache.guard.get\n"
+        "  --xfetch              Pass XFETCH to cache.guard.get\n"
+        "  --repl-bytes          Enable the AOF and report bytes written per read\n"
+        "  --hits                Read one never-expiring value: fresh-hit throughput\n"
+        "                        and server allocations per read\n"
+        "  --compress <bytes>    Set compress_threshold for the guarded run (0 = off)\n"
+        "  --raw                 Pass RAW to cache.guard.get (with --hits)\n");
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!strcmp(arg, "--lockmiss")) { opts.lockMiss = 1; continue; }
+        if (!strcmp(arg, "--xfetch")) { opts.xfetch = 1; continue; }
+        if (!strcmp(arg, "--repl-bytes")) { opts.replBytes = 1; continue; }
+        if (!strcmp(arg, "--hits")) { opts.hits = 1; continue; }
+        if (!strcmp(arg, "--raw")) { opts.raw = 1; continue; }
+        if (!val) Usage();
+        i++;
+        if (!strcmp(arg, "--host")) opts.host = val;
+        else if (!strcmp(arg, "--port")) opts.port = atoi(val);
+        else if (!strcmp(arg, "--clients")) opts.clients = atoi(val);
+        else if (!strcmp(arg, "--keys")) opts.keys = atoi(val);
+        else if (!strcmp(arg, "--zipf")) opts.zipf = atof(val);
+        else if (!strcmp(arg, "--duration")) opts.duration = atoi(val);
+        else if (!strcmp(arg, "--ttl")) opts.ttl = atoll(val);
+        else if (!strcmp(arg, "--grace")) opts.grace = atoll(val);
+        else if (!strcmp(arg, "--backend")) opts.backend = atoll(val);
+        else if (!strcmp(arg, "--value-size")) opts.valueSize = strtoull(val, NULL, 10);
+        else if (!strcmp(arg, "--compress")) opts.compress = atoll(val);
+        else if (!strcmp(arg, "--mode")) {
+            if (!strcmp(val, "plain")) opts.modes = 1 << MODE_PLAIN;
+            else if (!strcmp(val, "guarded")) opts.modes = 1 << MODE_GUARDED;
+            else if (!strcmp(val, "both")) opts.modes = (1 << MODE_PLAIN) | (1 << MODE_GUARDED);
+            else Usage();
+        } else Usage();
+    }
+    if (opts.clients < 1 || opts.keys < 1 || opts.duration < 1 || opts.ttl < 1000 ||
+        opts.grace < 100 || opts.backend < 0 || opts.zipf < 0) {
+        Usage();
+    }
+
+    BuildZipf();
+    lastRegenAt = calloc(opts.keys, sizeof(long long));
+    benchValue = malloc(opts.valueSize ? opts.valueSize : 1);
+    if (opts.hits) {
+        FillTextValue(benchValue, opts.valueSize);
+    } else {
+        memset(benchValue, 'v', opts.valueSize);
+    }
+
+    Client *admin = AdminConnect();
+    if (opts.hits) {
+        printf("clients=%d value=%zuB fresh hits%s%s\n", opts.clients, opts.valueSize,
+               opts.compress > 0 ? " compressed" : "", opts.raw ? " raw" : "");
+        printf("%-8s %12s %9s %9s %9s %9s %7s %11s %11s %11s\n", "mode", "reads/s", "p50(us)",
+               "p99(us)", "p999(us)", "max(us)", "errors", "set p50(us)", "set max(us)",
+               "allocs/read");
+    } else {
+        printf("clients=%d keys=%d zipf=%.2f ttl=%lldms grace=%lldms backend=%lldms value=%zuB%s%s\n",
+               opts.clients, opts.keys, opts.zipf, opts.ttl, opts.grace, opts.backend,
+               opts.valueSize, opts.lockMiss ? " lockmiss" : "", opts.xfetch ? " xfetch" : "");
+        if (opts.replBytes) {
+            EnableAof(admin);
+        }
+        printf("%-8s %12s %9s %9s %9s %9s %12s %10s %8s %7s%s\n", "mode", "reads/s",
+               "p50(us)", "p99(us)", "p999(us)", "max(us)", "regens", "regen/exp", "busy", "errors",
+               opts.replBytes ? "   aofB/read" : "");
+    }
+    for (int m = MODE_PLAIN; m <= MODE_GUARDED; m++) {
+        if (opts.modes & (1 << m)) {
+            RunMode(m, admin);
+        }
+    }
+    AdminClose(admin);
+
+    free(zipfCdf);
+    free(lastRegenAt);
+    free(benchValue);
+    return 0;
+}
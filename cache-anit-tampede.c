@@ -1,7 +1,11 @@
 #include "redismodule.h"
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <time.h>
 
 // Configuration constants
 #define REGEN_LOCK_SUFFIX ":regen_lock"
@@ -11,18 +15,138 @@
 #define MAX_GRACE_PERIOD_MS (24 * 60 * 60 * 1000) // 24 hours
 #define MIN_EXPIRE_MS 1000
 #define MAX_EXPIRE_MS (7 * 24 * 60 * 60 * 1000) // 7 days
+#define MAX_VALUE_SIZE (10 * 1024 * 1024) // 10MB
+#define VALUE_CHUNK_SIZE (64 * 1024)    // Unit of compression, range reads and chunked replies
+
+// Native guarded value type (type names must be exactly 9 characters)
+#define CACHEGUARD_TYPE_NAME "cguardval"
+#define CACHEGUARD_TYPE_ENCVER 8
 
 // Module context for configuration
 static struct {
     int log_level;
-    long long default_grace_period;
+    long long default_grace_period; // Grace for prefixes with no measured regenerations
     long long max_lock_duration;
+    int xfetch;                 // Probabilistic early recomputation by default
+    double xfetch_beta;         // XFetch aggressiveness (>1 favours earlier refresh)
+    int lock_on_miss;           // Hand out a regeneration lease on cold misses
+    long long default_lease;    // Lease duration when LEASE is not given (0 = grace period)
+    long long grace_margin;     // Safety margin added to the learned grace, percent
+    int grace_prefix_depth;     // ':'-separated key segments that form a grace prefix
+    long long compress_threshold; // Compress values of at least this many bytes (0 = off)
+    long long default_jitter;   // Expiry jitter for set/mset without JITTER, percent
+    int hotkeys;                // Feed the hot key sketch from get/mget/set/mset
+    long long hotkeys_halflife; // Hot key counters halve this often, ms (0 = never)
+    int refresh_ahead;          // Queue grace-window regenerations on refresh_stream
+    char refresh_stream[MAX_KEY_LENGTH + 1]; // Stream that receives regeneration jobs
+    long long refresh_stream_maxlen; // Approximate cap on the stream length (0 = none)
+    int regen_queue;            // Queue regenerations for cache.guard.claim workers
 } module_config = {
     .log_level = 1,  // 0=debug, 1=notice, 2=warning, 3=error
     .default_grace_period = 5000,
-    .max_lock_duration = 30000
+    .max_lock_duration = 30000,
+    .xfetch = 0,
+    .xfetch_beta = 1.0,
+    .lock_on_miss = 0,
+    .default_lease = 0,
+    .grace_margin = 50,
+    .grace_prefix_depth = 1,
+    .compress_threshold = 0,
+    .default_jitter = 0,
+    .hotkeys = 1,
+    .hotkeys_halflife = 60000,
+    .refresh_ahead = 0,
+    .refresh_stream = "cacheguard:refresh",
+    .refresh_stream_maxlen = 100000,
+    .regen_queue = 0
+};
+
+// Entry flags. A new flag raises CACHEGUARD_TYPE_ENCVER even when the layout
+// stays the same, so that versions which would misread the entry refuse it.
+#define ENTRY_FLAG_PENDING (1 << 0)     // Lease-only placeholder taken on a miss
+#define ENTRY_FLAG_LZ4 (1 << 1)         // value holds a compressed payload (encver 5)
+#define ENTRY_FLAG_MISSING (1 << 2)     // Tombstone: the entity is known not to exist (encver 6)
+#define ENTRY_FLAG_STALE (1 << 3)       // Due for regeneration now (cache.guard.stale, encver 8)
+#define ENTRY_FLAGS_NO_VALUE (ENTRY_FLAG_PENDING | ENTRY_FLAG_MISSING)
+
+// A guarded cache entry: the value plus its regeneration lease in one key.
+// expire_at is the logical expiry the grace window is measured against; the
+// key's own Redis TTL is set to the same instant by cache.guard.set.
+typedef struct CacheGuardEntry {
+    RedisModuleString *value;           // NULL for placeholders and tombstones
+    unsigned int flags;
+    long long expire_at;                // Logical expiry, unix time in ms
+    unsigned long long lease_holder;    // Client id that holds the lease
+    long long lease_deadline;           // Lease expiry, unix time in ms (0 = free)
+    long long lease_granted_at;         // When the current lease was granted
+    long long delta;                    // Time the value took to compute, ms (0 = unknown)
+    unsigned long long token;           // Newest fencing token granted or written
+    RedisModuleString *tags;            // NUL-terminated tag names (encver 7), or NULL
+    unsigned long long generation;      // Namespace clock when written; not persisted
+} CacheGuardEntry;
+
+static RedisModuleType *CacheGuardType = NULL;
+
+// Request counters, reported by INFO cacheguard and cache.guard.info
+static struct {
+    unsigned long long fresh_hits;      // Value served outside its grace window
+    unsigned long long stale_serves;    // Stale value served while another client regenerates
+    unsigned long long regen_grants;    // Regeneration lock handed to the caller
+    unsigned long long cold_misses;     // Key not found (or only a lock-on-miss placeholder)
+    unsigned long long lock_contention; // Lock wanted but already held by another client
+    unsigned long long lock_failures;   // Lock could not be taken because of an error
+    unsigned long long sets;            // Values written by set/mset
+    unsigned long long lock_releases;   // Locks released by a set
+    unsigned long long fenced_writes;   // Sets rejected for carrying an outdated token
+    unsigned long long compressed_sets; // Values stored compressed
+    unsigned long long compression_saved_bytes; // Bytes not stored or replicated thanks to compression
+    unsigned long long jittered_sets;   // Writes whose expiry was jittered
+    unsigned long long tombstone_sets;  // Tombstones written by setmissing
+    unsigned long long missing_hits;    // Known-missing replies (tombstone or Bloom filter)
+    unsigned long long bloom_rejects;   // Known-missing replies that never opened the key
+    unsigned long long refresh_jobs;    // Regeneration jobs added to refresh_stream
+    unsigned long long refresh_failures; // Jobs that could not be added (regenerated inline)
+    unsigned long long queue_jobs;      // Keys added to the regeneration queue
+    unsigned long long queue_claims;    // Jobs handed to workers by cache.guard.claim
+    unsigned long long queue_requeues;  // Claims whose lease ran out before a write
+    unsigned long long invalidated_keys; // Keys dropped or marked stale by cache.guard.invalidate
+    unsigned long long stale_marks;     // Values marked due for regeneration
+    unsigned long long ns_bumps;        // Namespace generations advanced
+    unsigned long long outdated_deletes; // Entries deleted on read after a HARD bump
+} guard_stats;
+
+static const struct {
+    const char *name;
+    unsigned long long *counter;
+} GuardStatFields[] = {
+    { "fresh_hits", &guard_stats.fresh_hits },
+    { "stale_serves", &guard_stats.stale_serves },
+    { "regen_grants", &guard_stats.regen_grants },
+    { "cold_misses", &guard_stats.cold_misses },
+    { "lock_contention", &guard_stats.lock_contention },
+    { "lock_failures", &guard_stats.lock_failures },
+    { "sets", &guard_stats.sets },
+    { "lock_releases", &guard_stats.lock_releases },
+    { "fenced_writes", &guard_stats.fenced_writes },
+    { "compressed_sets", &guard_stats.compressed_sets },
+    { "compression_saved_bytes", &guard_stats.compression_saved_bytes },
+    { "jittered_sets", &guard_stats.jittered_sets },
+    { "tombstone_sets", &guard_stats.tombstone_sets },
+    { "missing_hits", &guard_stats.missing_hits },
+    { "bloom_rejects", &guard_stats.bloom_rejects },
+    { "refresh_jobs", &guard_stats.refresh_jobs },
+    { "refresh_failures", &guard_stats.refresh_failures },
+    { "queue_jobs", &guard_stats.queue_jobs },
+    { "queue_claims", &guard_stats.queue_claims },
+    { "queue_requeues", &guard_stats.queue_requeues },
+    { "invalidated_keys", &guard_stats.invalidated_keys },
+    { "stale_marks", &guard_stats.stale_marks },
+    { "ns_bumps", &guard_stats.ns_bumps },
+    { "outdated_deletes", &guard_stats.outdated_deletes }
 };
 
+#define GUARD_STAT_FIELDS (sizeof(GuardStatFields) / sizeof(GuardStatFields[0]))
+
 // Logging macros
 #define LOG_DEBUG(ctx, fmt, ...) \
     if (module_config.log_level <= 0) \
@@ -36,7 +160,334 @@ static struct {
     if (module_config.log_level <= 2) \
         RedisModule_Log(ctx, REDISMODULE_LOGLEVEL_WARNING, "CacheGuard: " fmt, ##__VA_ARGS__)
 
-// Enhanced lock key generation with safety checks
+// xorshift64* generator for sampling decisions on the request path
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t NextRandom(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+// Uniform sample in (0, 1]
+static double RandomUnit(void) {
+    return ((NextRandom() >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+// Fencing tokens: every lease grant gets the next value of a server-wide
+// counter, and cache.guard.set ... TOKEN rejects writes older than the
+// entry's newest token. The counter is raised past every token seen on load
+// so tokens stay monotonic across restarts.
+static unsigned long long last_lease_token = 0;
+
+// Namespace generation clock, advanced by every cache.guard.ns.bump. Entries
+// are stamped with it when written (see the namespace section below).
+static unsigned long long ns_clock = 0;
+
+static unsigned long long NextLeaseToken(void) {
+    return ++last_lease_token;
+}
+
+static void ObserveLeaseToken(unsigned long long token) {
+    if (token > last_lease_token) {
+        last_lease_token = token;
+    }
+}
+
+// Value compression. A compressed payload is an 8-byte header, the magic
+// "\0LZC" and the original length as 32-bit little endian, followed by one
+// LZ4 block per VALUE_CHUNK_SIZE bytes of the value, each prefixed with its
+// 32-bit little-endian compressed size. The leading NUL lets clients reading
+// stored bytes (cache.guard.get ... RAW) tell a compressed payload from JSON
+// or HTML text, and independent chunks let range reads and chunked replies
+// decode only what they send. Payloads written before values were chunked
+// carry the magic "\0LZ4" and a single LZ4 block for the whole value; they
+// are still read. The codec is a plain greedy LZ4 compressor (one hash probe
+// per position, skipping ahead faster through incompressible data) and a
+// bounds-checked decoder; any LZ4 block decoder can read a chunk.
+#define LZ4_HEADER "\0LZC"
+#define LZ4_HEADER_SINGLE "\0LZ4"
+#define LZ4_HEADER_LEN 8
+#define LZ4_HASH_LOG 12
+#define LZ4_MIN_MATCH 4
+#define LZ4_MF_LIMIT 12                 // Last match starts at least this far from the end
+#define LZ4_LAST_LITERALS 5             // Block always ends with this many literals
+#define LZ4_MAX_OFFSET 65535
+
+static size_t Lz4CompressBound(size_t len) {
+    return len + len / 255 + 16;
+}
+
+static uint32_t Lz4Read32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static unsigned char *Lz4WriteLength(unsigned char *op, size_t len) {
+    for (; len >= 255; len -= 255) {
+        *op++ = 255;
+    }
+    *op++ = (unsigned char)len;
+    return op;
+}
+
+// Compresses src into dst (at least Lz4CompressBound(srcLen) bytes) and
+// returns the compressed size
+static size_t Lz4Compress(const unsigned char *src, size_t srcLen, unsigned char *dst) {
+    uint32_t table[1 << LZ4_HASH_LOG] = { 0 };
+    const unsigned char *ip = src, *anchor = src, *end = src + srcLen;
+    unsigned char *op = dst;
+
+    if (srcLen > LZ4_MF_LIMIT) {
+        const unsigned char *mfLimit = end - LZ4_MF_LIMIT;
+        const unsigned char *matchLimit = end - LZ4_LAST_LITERALS;
+        unsigned misses = 0;
+        while (ip < mfLimit) {
+            uint32_t seq = Lz4Read32(ip);
+            uint32_t h = (seq * 2654435761U) >> (32 - LZ4_HASH_LOG);
+            const unsigned char *ref = src + table[h];
+            table[h] = (uint32_t)(ip - src);
+            if (ref >= ip || ip - ref > LZ4_MAX_OFFSET || Lz4Read32(ref) != seq) {
+                ip += 1 + (misses++ >> 6);
+                continue;
+            }
+            misses = 0;
+
+            const unsigned char *m = ip + LZ4_MIN_MATCH, *r = ref + LZ4_MIN_MATCH;
+            while (m < matchLimit && *m == *r) {
+                m++;
+                r++;
+            }
+            size_t litLen = ip - anchor, matchLen = m - ip - LZ4_MIN_MATCH;
+            size_t offset = ip - ref;
+
+            unsigned char *token = op++;
+            *token = (unsigned char)((litLen < 15 ? litLen : 15) << 4);
+            if (litLen >= 15) op = Lz4WriteLength(op, litLen - 15);
+            memcpy(op, anchor, litLen);
+            op += litLen;
+            *op++ = (unsigned char)(offset & 0xff);
+            *op++ = (unsigned char)(offset >> 8);
+            *token |= (unsigned char)(matchLen < 15 ? matchLen : 15);
+            if (matchLen >= 15) op = Lz4WriteLength(op, matchLen - 15);
+            ip = anchor = m;
+        }
+    }
+
+    size_t litLen = end - anchor;
+    *op++ = (unsigned char)((litLen < 15 ? litLen : 15) << 4);
+    if (litLen >= 15) op = Lz4WriteLength(op, litLen - 15);
+    memcpy(op, anchor, litLen);
+    op += litLen;
+    return op - dst;
+}
+
+// Decodes exactly dstLen bytes; returns -1 on malformed input
+static int Lz4Decompress(const unsigned char *src, size_t srcLen, unsigned char *dst, size_t dstLen) {
+    const unsigned char *ip = src, *iend = src + srcLen;
+    unsigned char *op = dst, *oend = dst + dstLen;
+
+    while (ip < iend) {
+        unsigned token = *ip++;
+        size_t litLen = token >> 4;
+        if (litLen == 15) {
+            unsigned char b;
+            do {
+                if (ip >= iend) return -1;
+                b = *ip++;
+                litLen += b;
+            } while (b == 255);
+        }
+        if (litLen > (size_t)(iend - ip) || litLen > (size_t)(oend - op)) return -1;
+        memcpy(op, ip, litLen);
+        ip += litLen;
+        op += litLen;
+        if (ip == iend) break;
+
+        if (iend - ip < 2) return -1;
+        size_t offset = ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - dst)) return -1;
+        size_t matchLen = token & 15;
+        if (matchLen == 15) {
+            unsigned char b;
+            do {
+                if (ip >= iend) return -1;
+                b = *ip++;
+                matchLen += b;
+            } while (b == 255);
+        }
+        matchLen += LZ4_MIN_MATCH;
+        if (matchLen > (size_t)(oend - op)) return -1;
+        // A match closer than its length overlaps the bytes it produces and
+        // has to be copied forward one byte at a time
+        const unsigned char *match = op - offset;
+        if (offset >= matchLen) {
+            memcpy(op, match, matchLen);
+            op += matchLen;
+        } else {
+            while (matchLen--) *op++ = *match++;
+        }
+    }
+    return op == oend ? 0 : -1;
+}
+
+static void Lz4WriteU32(unsigned char *p, size_t v) {
+    for (int i = 0; i < 4; i++) {
+        p[i] = (unsigned char)(v >> (8 * i));
+    }
+}
+
+static size_t Lz4ReadU32(const unsigned char *p) {
+    return p[0] | (size_t)p[1] << 8 | (size_t)p[2] << 16 | (size_t)p[3] << 24;
+}
+
+// Sequential access to the chunks of a compressed payload. A single-block
+// payload reads as one unframed chunk holding the whole value.
+typedef struct Lz4Reader {
+    const unsigned char *pos, *end;
+    size_t remaining;                   // Decoded bytes still ahead
+    size_t chunkSize;                   // Decoded size of every chunk but the last
+    int framed;                         // Chunks are prefixed with their size
+} Lz4Reader;
+
+// Checks the header and chunk framing of a payload. Returns the original
+// length, or -1 if the payload is malformed.
+static long long Lz4ReaderInit(Lz4Reader *r, const char *payload, size_t len) {
+    if (len < LZ4_HEADER_LEN) {
+        return -1;
+    }
+    const unsigned char *p = (const unsigned char *)payload;
+    size_t total = Lz4ReadU32(p + 4);
+    if (total > MAX_VALUE_SIZE) {
+        return -1;
+    }
+
+    r->pos = p + LZ4_HEADER_LEN;
+    r->end = p + len;
+    r->remaining = total;
+    if (memcmp(payload, LZ4_HEADER_SINGLE, 4) == 0) {
+        r->chunkSize = total;
+        r->framed = 0;
+        return total;
+    }
+    if (memcmp(payload, LZ4_HEADER, 4) != 0) {
+        return -1;
+    }
+    r->chunkSize = VALUE_CHUNK_SIZE;
+    r->framed = 1;
+    const unsigned char *q = r->pos;
+    for (size_t left = total; left > 0; left -= left < VALUE_CHUNK_SIZE ? left : VALUE_CHUNK_SIZE) {
+        if (r->end - q < 4 || Lz4ReadU32(q) > (size_t)(r->end - q - 4)) {
+            return -1;
+        }
+        q += 4 + Lz4ReadU32(q);
+    }
+    return q == r->end ? (long long)total : -1;
+}
+
+// Decoded size of the next chunk
+static size_t Lz4ReaderChunkLen(const Lz4Reader *r) {
+    return r->remaining < r->chunkSize ? r->remaining : r->chunkSize;
+}
+
+static void Lz4ReaderSkip(Lz4Reader *r) {
+    r->remaining -= Lz4ReaderChunkLen(r);
+    r->pos = r->framed ? r->pos + 4 + Lz4ReadU32(r->pos) : r->end;
+}
+
+// Decodes the next chunk into dst (room for Lz4ReaderChunkLen bytes)
+static int Lz4ReaderNext(Lz4Reader *r, unsigned char *dst) {
+    size_t n = Lz4ReaderChunkLen(r);
+    const unsigned char *block = r->framed ? r->pos + 4 : r->pos;
+    size_t blockLen = r->framed ? Lz4ReadU32(r->pos) : (size_t)(r->end - r->pos);
+    if (Lz4Decompress(block, blockLen, dst, n) != 0) {
+        return -1;
+    }
+    Lz4ReaderSkip(r);
+    return 0;
+}
+
+// Decodes count bytes starting at offset, touching only the chunks they span
+static int Lz4ReaderRange(Lz4Reader *r, size_t offset, size_t count, char *dst) {
+    while (r->remaining > 0 && offset >= r->chunkSize) {
+        offset -= r->chunkSize;
+        Lz4ReaderSkip(r);
+    }
+    unsigned char *scratch = NULL;
+    int ret = 0;
+    while (count > 0) {
+        size_t n = Lz4ReaderChunkLen(r);
+        size_t take = n - offset < count ? n - offset : count;
+        if (offset == 0 && take == n) {
+            ret = Lz4ReaderNext(r, (unsigned char *)dst);
+        } else {
+            // Partial chunk at either end of the range
+            if (!scratch) scratch = RedisModule_Alloc(r->chunkSize);
+            ret = Lz4ReaderNext(r, scratch);
+            if (ret == 0) memcpy(dst, scratch + offset, take);
+        }
+        if (ret != 0) break;
+        dst += take;
+        count -= take;
+        offset = 0;
+    }
+    if (scratch) RedisModule_Free(scratch);
+    return ret;
+}
+
+// Returns a compressed copy of value, or NULL when it is below
+// compress_threshold or would not shrink by at least an eighth. Every chunk
+// is an independent LZ4 block.
+static RedisModuleString *CompressValue(RedisModuleString *value) {
+    size_t len;
+    const char *ptr = RedisModule_StringPtrLen(value, &len);
+    if (!module_config.compress_threshold || (long long)len < module_config.compress_threshold) {
+        return NULL;
+    }
+
+    size_t chunks = (len + VALUE_CHUNK_SIZE - 1) / VALUE_CHUNK_SIZE;
+    unsigned char *buf = RedisModule_Alloc(LZ4_HEADER_LEN + chunks * (4 + Lz4CompressBound(VALUE_CHUNK_SIZE)));
+    memcpy(buf, LZ4_HEADER, 4);
+    Lz4WriteU32(buf + 4, len);
+    unsigned char *op = buf + LZ4_HEADER_LEN;
+    for (size_t off = 0; off < len; off += VALUE_CHUNK_SIZE) {
+        size_t n = len - off < VALUE_CHUNK_SIZE ? len - off : VALUE_CHUNK_SIZE;
+        size_t packed = Lz4Compress((const unsigned char *)ptr + off, n, op + 4);
+        Lz4WriteU32(op, packed);
+        op += 4 + packed;
+    }
+    size_t packed = op - buf;
+
+    RedisModuleString *compressed = NULL;
+    if (packed <= len - len / 8) {
+        compressed = RedisModule_CreateString(NULL, (const char *)buf, packed);
+        guard_stats.compressed_sets++;
+        guard_stats.compression_saved_bytes += len - packed;
+    }
+    RedisModule_Free(buf);
+    return compressed;
+}
+
+// Redis Cluster hashes only the part between the first '{' and the next '}'
+// when that part is non-empty. Returns 1 if the key has such a hash tag.
+static int KeyHasHashTag(const char *key, size_t len) {
+    const char *open = memchr(key, '{', len);
+    if (!open) {
+        return 0;
+    }
+    size_t rest = len - (open - key) - 1;
+    const char *close = memchr(open + 1, '}', rest);
+    return close && close > open + 1;
+}
+
+// Enhanced lock key generation with safety checks. The lock key must hash
+// to the value's cluster slot: keys with a hash tag keep it by appending the
+// suffix, other keys are wrapped as "{key}:regen_lock". A key containing '}'
+// but no tag cannot be wrapped without changing its slot and keeps the plain
+// suffix, which is only correct outside cluster mode.
 static RedisModuleString *CreateLockKey(RedisModuleCtx *ctx, RedisModuleString *key) {
     size_t len;
     const char *keystr = RedisModule_StringPtrLen(key, &len);
@@ -52,16 +503,22 @@ static RedisModuleString *CreateLockKey(RedisModuleCtx *ctx, RedisModuleString *
         return NULL;
     }
     
+    int wrap = !KeyHasHashTag(keystr, len) && !memchr(keystr, '}', len);
+
     // Safe buffer allocation and construction
-    size_t lockNameLen = len + sizeof(REGEN_LOCK_SUFFIX) - 1;
+    size_t lockNameLen = len + sizeof(REGEN_LOCK_SUFFIX) - 1 + (wrap ? 2 : 0);
     char *lockName = RedisModule_Alloc(lockNameLen + 1);
     if (!lockName) {
         LOG_WARNING(ctx, "Failed to allocate memory for lock key");
         return NULL;
     }
     
-    memcpy(lockName, keystr, len);
-    memcpy(lockName + len, REGEN_LOCK_SUFFIX, sizeof(REGEN_LOCK_SUFFIX) - 1);
+    char *p = lockName;
+    if (wrap) *p++ = '{';
+    memcpy(p, keystr, len);
+    p += len;
+    if (wrap) *p++ = '}';
+    memcpy(p, REGEN_LOCK_SUFFIX, sizeof(REGEN_LOCK_SUFFIX) - 1);
     lockName[lockNameLen] = '\0';
     
     RedisModuleString *lockKey = RedisModule_CreateString(ctx, lockName, lockNameLen);
@@ -70,8 +527,10 @@ static RedisModuleString *CreateLockKey(RedisModuleCtx *ctx, RedisModuleString *
     return lockKey;
 }
 
-// Enhanced lock acquisition with better error handling
-int TryAcquireLock(RedisModuleCtx *ctx, RedisModuleString *key, long long lockExpireMs) {
+// Enhanced lock acquisition with better error handling. The lock key holds
+// the fencing token of the grant, returned through *token.
+int TryAcquireLock(RedisModuleCtx *ctx, RedisModuleString *key, long long lockExpireMs,
+                   unsigned long long *token) {
     if (!key) {
         LOG_WARNING(ctx, "NULL key provided to TryAcquireLock");
         return 0;
@@ -80,213 +539,3121 @@ int TryAcquireLock(RedisModuleCtx *ctx, RedisModuleString *key, long long lockEx
     // Validate lock expiration time
     if (lockExpireMs < MIN_GRACE_PERIOD_MS || lockExpireMs > module_config.max_lock_duration) {
         LOG_WARNING(ctx, "Invalid lock expiration: %lld ms", lockExpireMs);
+        guard_stats.lock_failures++;
         return 0;
     }
     
     RedisModuleString *lockKey = CreateLockKey(ctx, key);
     if (!lockKey) {
+        guard_stats.lock_failures++;
         return 0;
     }
     
     RedisModuleKey *lock = RedisModule_OpenKey(ctx, lockKey, REDISMODULE_WRITE);
     if (!lock) {
         LOG_WARNING(ctx, "Failed to open lock key");
+        RedisModule_FreeString(ctx, lockKey);
+        guard_stats.lock_failures++;
         return 0;
     }
     
     int acquired = 0;
     if (RedisModule_KeyType(lock) == REDISMODULE_KEYTYPE_EMPTY) {
-        RedisModuleString *lockValue = RedisModule_CreateStringFromLongLong(ctx, 1);
-        if (RedisModule_StringSet(lock, lockValue) == REDISMODULE_OK) {
+        unsigned long long lockToken = NextLeaseToken();
+        RedisModuleString *lockValue = RedisModule_CreateStringFromLongLong(ctx, (long long)lockToken);
+        int setResult = RedisModule_StringSet(lock, lockValue);
+        RedisModule_FreeString(ctx, lockValue);
+        if (setResult == REDISMODULE_OK) {
             if (RedisModule_SetExpire(lock, lockExpireMs) == REDISMODULE_OK) {
                 acquired = 1;
+                *token = lockToken;
                 LOG_DEBUG(ctx, "Lock acquired for key, expires in %lld ms", lockExpireMs);
             } else {
                 LOG_WARNING(ctx, "Failed to set lock expiration");
                 RedisModule_DeleteKey(lock);
+                guard_stats.lock_failures++;
             }
         } else {
             LOG_WARNING(ctx, "Failed to set lock value");
+            guard_stats.lock_failures++;
         }
     } else {
         LOG_DEBUG(ctx, "Lock already exists for key");
+        guard_stats.lock_contention++;
     }
     
     RedisModule_CloseKey(lock);
+    RedisModule_FreeString(ctx, lockKey);
     return acquired;
 }
 
-// Enhanced GET command with comprehensive validation
-int CacheGuardGetCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
-    if (argc != 3) {
-        return RedisModule_WrongArity(ctx);
+// Lease acquisition on a native entry: same limits as TryAcquireLock, but the
+// lock is two fields in the entry instead of a sibling key.
+static int ValidLeaseDuration(long long lockExpireMs) {
+    return lockExpireMs >= MIN_GRACE_PERIOD_MS && lockExpireMs <= module_config.max_lock_duration;
+}
+
+static int TryAcquireLease(RedisModuleCtx *ctx, CacheGuardEntry *entry, long long lockExpireMs) {
+    if (!ValidLeaseDuration(lockExpireMs)) {
+        LOG_WARNING(ctx, "Invalid lock expiration: %lld ms", lockExpireMs);
+        guard_stats.lock_failures++;
+        return 0;
     }
 
-    RedisModule_AutoMemory(ctx);
-    
-    RedisModuleString *key = argv[1];
-    if (!key) {
-        return RedisModule_ReplyWithError(ctx, "ERR invalid key");
+    long long now = RedisModule_Milliseconds();
+    if (entry->lease_deadline > now) {
+        LOG_DEBUG(ctx, "Lease already held by client %llu", entry->lease_holder);
+        guard_stats.lock_contention++;
+        return 0;
     }
-    
-    // Validate grace period
-    long long gracePeriodMs;
-    if (RedisModule_StringToLongLong(argv[2], &gracePeriodMs) != REDISMODULE_OK) {
-        return RedisModule_ReplyWithError(ctx, "ERR invalid grace period format");
+
+    entry->lease_holder = RedisModule_GetClientId(ctx);
+    entry->lease_granted_at = now;
+    entry->lease_deadline = now + lockExpireMs;
+    entry->token = NextLeaseToken();
+    LOG_DEBUG(ctx, "Lock acquired for key, expires in %lld ms", lockExpireMs);
+    return 1;
+}
+
+static CacheGuardEntry *CacheGuardEntryCreate(void) {
+    CacheGuardEntry *entry = RedisModule_Calloc(1, sizeof(*entry));
+    entry->generation = ns_clock;
+    return entry;
+}
+
+static void CacheGuardEntryFree(void *value) {
+    CacheGuardEntry *entry = value;
+    if (!entry) return;
+    if (entry->value) RedisModule_FreeString(NULL, entry->value);
+    if (entry->tags) RedisModule_FreeString(NULL, entry->tags);
+    RedisModule_Free(entry);
+}
+
+// Returns the native entry stored at an open key, or NULL for any other type
+static CacheGuardEntry *GetGuardEntry(RedisModuleKey *k) {
+    if (RedisModule_KeyType(k) != REDISMODULE_KEYTYPE_MODULE ||
+        RedisModule_ModuleTypeGetType(k) != CacheGuardType) {
+        return NULL;
     }
-    
-    if (gracePeriodMs < MIN_GRACE_PERIOD_MS || gracePeriodMs > MAX_GRACE_PERIOD_MS) {
-        return RedisModule_ReplyWithError(ctx, 
-            "ERR grace period must be between 100ms and 24 hours");
+    return RedisModule_ModuleTypeGetValue(k);
+}
+
+static void TagIndexAdd(int db, RedisModuleString *key, RedisModuleString *tags);
+static int NamespaceOutdated(RedisModuleString *key, const CacheGuardEntry *entry);
+
+enum { NS_CURRENT, NS_OUTDATED, NS_OUTDATED_HARD };
+
+static void *CacheGuardTypeRdbLoad(RedisModuleIO *rdb, int encver) {
+    if (encver > CACHEGUARD_TYPE_ENCVER) {
+        RedisModule_LogIOError(rdb, REDISMODULE_LOGLEVEL_WARNING,
+            "CacheGuard: can't load entry encoding version %d", encver);
+        return NULL;
     }
 
-    // Validate key length
-    size_t keyLen;
-    RedisModule_StringPtrLen(key, &keyLen);
-    if (keyLen == 0) {
-        return RedisModule_ReplyWithError(ctx, "ERR empty key not allowed");
+    CacheGuardEntry *entry = CacheGuardEntryCreate();
+    if (encver >= 3) {
+        entry->flags = RedisModule_LoadUnsigned(rdb);
     }
-    if (keyLen > MAX_KEY_LENGTH) {
-        return RedisModule_ReplyWithError(ctx, "ERR key too long");
+    if (!(entry->flags & ENTRY_FLAGS_NO_VALUE)) {
+        entry->value = RedisModule_LoadString(rdb);
+    }
+    entry->expire_at = RedisModule_LoadSigned(rdb);
+    entry->lease_holder = RedisModule_LoadUnsigned(rdb);
+    entry->lease_deadline = RedisModule_LoadSigned(rdb);
+    if (encver >= 2) {
+        entry->lease_granted_at = RedisModule_LoadSigned(rdb);
+        entry->delta = RedisModule_LoadSigned(rdb);
+    }
+    if (encver >= 4) {
+        entry->token = RedisModule_LoadUnsigned(rdb);
+        ObserveLeaseToken(entry->token);
+    }
+    if (encver >= 7) {
+        entry->tags = RedisModule_LoadString(rdb);
+        size_t tagsLen;
+        RedisModule_StringPtrLen(entry->tags, &tagsLen);
+        if (tagsLen == 0) {
+            RedisModule_FreeString(NULL, entry->tags);
+            entry->tags = NULL;
+        }
+    }
+    // File loaded keys in the tag index. Keys already past their expiry may
+    // be discarded right after loading without a notification, so skip them.
+    if (entry->tags && entry->expire_at > RedisModule_Milliseconds() &&
+        RedisModule_GetKeyNameFromIO != NULL && RedisModule_GetDbIdFromIO != NULL) {
+        const RedisModuleString *key = RedisModule_GetKeyNameFromIO(rdb);
+        int db = RedisModule_GetDbIdFromIO(rdb);
+        if (key && db >= 0) {
+            TagIndexAdd(db, (RedisModuleString *)key, entry->tags);
+        }
+    }
+    return entry;
+}
+
+// Entries outdated by a namespace bump are saved in their outdated form, so
+// the namespace table never needs persisting: as marked stale, or after a
+// HARD bump as a value-less placeholder whose lease has lapsed (a miss).
+// Tombstones are dropped by any bump (see MarkEntryStale), so they get the
+// placeholder too.
+static void CacheGuardTypeRdbSave(RedisModuleIO *rdb, void *value) {
+    CacheGuardEntry *entry = value;
+    const RedisModuleString *key = RedisModule_GetKeyNameFromIO ? RedisModule_GetKeyNameFromIO(rdb) : NULL;
+    int outdated = key ? NamespaceOutdated((RedisModuleString *)key, entry) : NS_CURRENT;
+    if (outdated == NS_OUTDATED_HARD || (outdated && (entry->flags & ENTRY_FLAG_MISSING))) {
+        RedisModule_SaveUnsigned(rdb, ENTRY_FLAG_PENDING);
+        RedisModule_SaveSigned(rdb, entry->expire_at);
+        RedisModule_SaveUnsigned(rdb, 0);
+        RedisModule_SaveSigned(rdb, 0);
+        RedisModule_SaveSigned(rdb, 0);
+        RedisModule_SaveSigned(rdb, entry->delta);
+        RedisModule_SaveUnsigned(rdb, entry->token);
+        RedisModule_SaveStringBuffer(rdb, "", 0);
+        return;
     }
 
-    RedisModuleKey *k = RedisModule_OpenKey(ctx, key, REDISMODULE_READ | REDISMODULE_WRITE);
-    if (!k) {
-        LOG_WARNING(ctx, "Failed to open key");
-        return RedisModule_ReplyWithError(ctx, "ERR failed to access key");
+    RedisModule_SaveUnsigned(rdb, entry->flags | (outdated ? ENTRY_FLAG_STALE : 0));
+    if (!(entry->flags & ENTRY_FLAGS_NO_VALUE)) {
+        RedisModule_SaveString(rdb, entry->value);
     }
-    
-    if (RedisModule_KeyType(k) == REDISMODULE_KEYTYPE_EMPTY) {
-        LOG_DEBUG(ctx, "Cache miss - key not found");
-        RedisModule_CloseKey(k);
-        return RedisModule_ReplyWithNull(ctx);
+    RedisModule_SaveSigned(rdb, entry->expire_at);
+    RedisModule_SaveUnsigned(rdb, entry->lease_holder);
+    RedisModule_SaveSigned(rdb, entry->lease_deadline);
+    RedisModule_SaveSigned(rdb, entry->lease_granted_at);
+    RedisModule_SaveSigned(rdb, entry->delta);
+    RedisModule_SaveUnsigned(rdb, entry->token);
+    if (entry->tags) {
+        RedisModule_SaveString(rdb, entry->tags);
+    } else {
+        RedisModule_SaveStringBuffer(rdb, "", 0);
     }
+}
 
-    // Check if key contains string data
-    if (RedisModule_KeyType(k) != REDISMODULE_KEYTYPE_STRING) {
-        RedisModule_CloseKey(k);
-        return RedisModule_ReplyWithError(ctx, "ERR key contains non-string data");
+// Leases are short-lived and tied to connected clients, so the rewrite only
+// restores the value (or tombstone), its logical expiry, compute time and
+// tags, and skips lease-only placeholders. The fencing token is kept so that writers holding
+// an older token stay fenced after a reload. A stale mark follows as its own
+// command; entries a namespace bump made stale get one too, and those a HARD
+// bump outdated, or tombstones any bump outdated, are skipped. Redis appends
+// the key TTL itself.
+static void CacheGuardTypeAofRewrite(RedisModuleIO *aof, RedisModuleString *key, void *value) {
+    CacheGuardEntry *entry = value;
+    int outdated = NamespaceOutdated(key, entry);
+    if ((entry->flags & ENTRY_FLAG_PENDING) || outdated == NS_OUTDATED_HARD ||
+        (outdated && (entry->flags & ENTRY_FLAG_MISSING))) {
+        return;
     }
+    if (entry->tags) {
+        if (entry->flags & ENTRY_FLAG_MISSING) {
+            RedisModule_EmitAOF(aof, "cache.guard.restore", "slcclclccs", key, entry->expire_at, "",
+                                "DELTA", entry->delta, "TOKEN", (long long)entry->token, "MISSING",
+                                "TAGS", entry->tags);
+        } else if (entry->flags & ENTRY_FLAG_LZ4) {
+            RedisModule_EmitAOF(aof, "cache.guard.restore", "slsclclccs", key, entry->expire_at,
+                                entry->value, "DELTA", entry->delta, "TOKEN", (long long)entry->token,
+                                "LZ4", "TAGS", entry->tags);
+        } else {
+            RedisModule_EmitAOF(aof, "cache.guard.restore", "slsclclcs", key, entry->expire_at,
+                                entry->value, "DELTA", entry->delta, "TOKEN", (long long)entry->token,
+                                "TAGS", entry->tags);
+        }
+    } else if (entry->flags & ENTRY_FLAG_MISSING) {
+        RedisModule_EmitAOF(aof, "cache.guard.restore", "slcclclc", key, entry->expire_at, "",
+                            "DELTA", entry->delta, "TOKEN", (long long)entry->token, "MISSING");
+    } else if (entry->flags & ENTRY_FLAG_LZ4) {
+        RedisModule_EmitAOF(aof, "cache.guard.restore", "slsclclc", key, entry->expire_at,
+                            entry->value, "DELTA", entry->delta, "TOKEN", (long long)entry->token,
+                            "LZ4");
+    } else {
+        RedisModule_EmitAOF(aof, "cache.guard.restore", "slsclcl", key, entry->expire_at,
+                            entry->value, "DELTA", entry->delta, "TOKEN", (long long)entry->token);
+    }
+    if ((entry->flags & ENTRY_FLAG_STALE) || outdated) {
+        RedisModule_EmitAOF(aof, "cache.guard.stale", "s", key);
+    }
+}
 
-    mstime_t ttl = RedisModule_GetExpire(k);
-    
-    // Get the value with error checking
-    size_t valueLen;
-    const char *valuePtr = RedisModule_StringDMA(k, &valueLen, REDISMODULE_READ);
-    if (!valuePtr) {
-        RedisModule_CloseKey(k);
-        return RedisModule_ReplyWithError(ctx, "ERR failed to read value");
+static size_t CacheGuardTypeMemUsage(const void *value) {
+    const CacheGuardEntry *entry = value;
+    size_t valueLen = 0, tagsLen = 0;
+    if (entry->value) {
+        RedisModule_StringPtrLen(entry->value, &valueLen);
     }
-    
-    RedisModuleString *val = RedisModule_CreateString(ctx, valuePtr, valueLen);
+    if (entry->tags) {
+        RedisModule_StringPtrLen(entry->tags, &tagsLen);
+    }
+    return sizeof(*entry) + valueLen + tagsLen;
+}
 
-    if (ttl == REDISMODULE_NO_EXPIRE || ttl > gracePeriodMs) {
-        // Cache valid and NOT within grace period
-        LOG_DEBUG(ctx, "Cache hit - returning fresh data (TTL: %lld ms)", ttl);
-        RedisModule_CloseKey(k);
-        return RedisModule_ReplyWithString(ctx, val);
+static void CacheGuardTypeDigest(RedisModuleDigest *md, void *value) {
+    CacheGuardEntry *entry = value;
+    if (entry->value) {
+        size_t valueLen;
+        const char *valuePtr = RedisModule_StringPtrLen(entry->value, &valueLen);
+        RedisModule_DigestAddStringBuffer(md, valuePtr, valueLen);
     }
+    if (entry->tags) {
+        size_t tagsLen;
+        const char *tagsPtr = RedisModule_StringPtrLen(entry->tags, &tagsLen);
+        RedisModule_DigestAddStringBuffer(md, tagsPtr, tagsLen);
+    }
+    RedisModule_DigestAddLongLong(md, entry->flags);
+    RedisModule_DigestAddLongLong(md, entry->expire_at);
+    RedisModule_DigestEndSequence(md);
+}
 
-    // Cache within grace period or expired: try to acquire regeneration lock
-    LOG_DEBUG(ctx, "Cache in grace period (TTL: %lld ms, grace: %lld ms)", ttl, gracePeriodMs);
-    
-    int lockAcquired = TryAcquireLock(ctx, key, gracePeriodMs);
-    RedisModule_CloseKey(k);
+// Outcome of the fresh/grace/lock decision for one key
+typedef enum {
+    GUARD_MISS = 0,     // Key not found
+    GUARD_FRESH,        // Value outside its grace window
+    GUARD_STALE,        // In grace window, another client holds the lock
+    GUARD_REGEN,        // In grace window (or missing), this client won the lock
+    GUARD_BUSY,         // Missing and another client is regenerating it
+    GUARD_MISSING       // Known not to exist (tombstone or Bloom filter)
+} GuardOutcome;
 
-    if (lockAcquired) {
-        LOG_DEBUG(ctx, "Lock acquired - requesting regeneration");
-        return RedisModule_ReplyWithNull(ctx);
-    } else {
-        LOG_DEBUG(ctx, "Lock held by another client - returning stale data");
-        return RedisModule_ReplyWithString(ctx, val);
+static const char *GuardOutcomeNames[] = { "miss", "fresh", "stale", "regen", "busy", "missing" };
+
+#define GUARD_OUTCOME_COUNT (sizeof(GuardOutcomeNames) / sizeof(GuardOutcomeNames[0]))
+
+// Latency histograms (HDR-style log-linear buckets, microsecond resolution).
+// Values below LATENCY_SUB_BUCKETS us get one bucket each; above that every
+// power of two is split into LATENCY_SUB_BUCKETS buckets, so reported
+// percentiles are within ~6% of the true value. Samples at or above
+// LATENCY_MAX_US (~67s) land in the top bucket.
+#define LATENCY_SUB_BITS 4
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BITS)
+#define LATENCY_MAX_BITS 26
+#define LATENCY_MAX_US ((1LL << LATENCY_MAX_BITS) - 1)
+#define LATENCY_BUCKETS ((LATENCY_MAX_BITS - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS)
+
+typedef struct LatencyHistogram {
+    unsigned long long count;
+    long long max_us;
+    unsigned long long buckets[LATENCY_BUCKETS];
+} LatencyHistogram;
+
+// One histogram per cache.guard.get outcome, plus one for cache.guard.set
+#define LATENCY_SET GUARD_OUTCOME_COUNT
+static LatencyHistogram latency_hist[GUARD_OUTCOME_COUNT + 1];
+
+static const char *LatencyHistogramName(size_t i) {
+    return i == LATENCY_SET ? "set" : GuardOutcomeNames[i];
+}
+
+static long long MonotonicMicros(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static int LatencyBucketIndex(long long us) {
+    if (us < LATENCY_SUB_BUCKETS) {
+        return us < 0 ? 0 : (int)us;
     }
+    if (us > LATENCY_MAX_US) {
+        us = LATENCY_MAX_US;
+    }
+    int shift = 63 - __builtin_clzll((unsigned long long)us) - LATENCY_SUB_BITS;
+    return (shift + 1) * LATENCY_SUB_BUCKETS + (int)((us >> shift) - LATENCY_SUB_BUCKETS);
 }
 
-// Enhanced SET command with validation and cleanup
-int CacheGuardSetCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
-    if (argc != 4) {
-        return RedisModule_WrongArity(ctx);
+// Highest value that maps to a bucket
+static long long LatencyBucketUpper(int idx) {
+    if (idx < LATENCY_SUB_BUCKETS) {
+        return idx;
     }
+    int shift = idx / LATENCY_SUB_BUCKETS - 1;
+    long long lower = (long long)(idx % LATENCY_SUB_BUCKETS + LATENCY_SUB_BUCKETS) << shift;
+    return lower + (1LL << shift) - 1;
+}
 
-    RedisModule_AutoMemory(ctx);
+static void LatencyRecord(size_t hist, long long startUs) {
+    LatencyHistogram *h = &latency_hist[hist];
+    long long us = MonotonicMicros() - startUs;
+    h->buckets[LatencyBucketIndex(us)]++;
+    h->count++;
+    if (us > h->max_us) {
+        h->max_us = us;
+    }
+}
 
-    RedisModuleString *key = argv[1];
-    RedisModuleString *value = argv[2];
-    
-    if (!key || !value) {
-        return RedisModule_ReplyWithError(ctx, "ERR invalid key or value");
+static long long LatencyPercentile(const LatencyHistogram *h, double pct) {
+    if (h->count == 0) {
+        return 0;
     }
-    
-    // Validate key length
-    size_t keyLen;
-    RedisModule_StringPtrLen(key, &keyLen);
-    if (keyLen == 0) {
-        return RedisModule_ReplyWithError(ctx, "ERR empty key not allowed");
+    unsigned long long rank = (unsigned long long)ceil(h->count * pct / 100.0);
+    if (rank == 0) rank = 1;
+    unsigned long long seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            long long upper = LatencyBucketUpper(i);
+            return upper < h->max_us ? upper : h->max_us;
+        }
     }
-    if (keyLen > MAX_KEY_LENGTH) {
-        return RedisModule_ReplyWithError(ctx, "ERR key too long");
+    return h->max_us;
+}
+
+// Hot keys: every guarded read and write bumps a Count-Min sketch, and keys
+// whose estimate beats the coldest tracked key enter a small Top-K list.
+// Counters are halved every hotkeys_halflife ms so the list follows current
+// traffic. Memory is fixed: the sketch is HOTKEYS_DEPTH x HOTKEYS_WIDTH
+// 32-bit counters (32KB) plus HOTKEYS_TOPK copied key names.
+#define HOTKEYS_DEPTH 4
+#define HOTKEYS_WIDTH 2048              // Power of two
+#define HOTKEYS_TOPK 32
+#define HOTKEYS_WRITE GUARD_OUTCOME_COUNT
+
+typedef struct HotKey {
+    char *key;                          // NULL for a free slot
+    size_t len;
+    uint64_t hash;
+    uint32_t count;                     // Sketch estimate of reads and writes
+    uint32_t stale_serves;              // Counted since the key entered the list
+    uint32_t regen_grants;
+} HotKey;
+
+static struct {
+    uint32_t sketch[HOTKEYS_DEPTH][HOTKEYS_WIDTH];
+    HotKey top[HOTKEYS_TOPK];
+    long long last_decay;               // Unix time in ms of the last halving
+} hotkeys;
+
+// FNV-1a; the two 32-bit halves give the sketch rows by double hashing
+static uint64_t HotKeyHash(const char *key, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)key[i];
+        h *= 0x100000001b3ULL;
     }
-    
-    // Validate value length (prevent excessive memory usage)
-    size_t valueLen;
-    RedisModule_StringPtrLen(value, &valueLen);
-    if (valueLen > 10 * 1024 * 1024) { // 10MB limit
-        return RedisModule_ReplyWithError(ctx, "ERR value too large");
+    return h;
+}
+
+static void HotKeyFree(HotKey *hk) {
+    RedisModule_Free(hk->key);
+    memset(hk, 0, sizeof(*hk));
+}
+
+// Hottest first
+static int CompareHotKeys(const void *a, const void *b) {
+    uint32_t x = (*(const HotKey *const *)a)->count, y = (*(const HotKey *const *)b)->count;
+    return (x < y) - (x > y);
+}
+
+static void HotKeysReset(void) {
+    for (int i = 0; i < HOTKEYS_TOPK; i++) {
+        if (hotkeys.top[i].key) HotKeyFree(&hotkeys.top[i]);
     }
-    
-    // Validate expiration time
-    long long expire;
-    if (RedisModule_StringToLongLong(argv[3], &expire) != REDISMODULE_OK) {
-        return RedisModule_ReplyWithError(ctx, "ERR invalid expire time format");
+    memset(hotkeys.sketch, 0, sizeof(hotkeys.sketch));
+    hotkeys.last_decay = RedisModule_Milliseconds();
+}
+
+// Halves every counter once per elapsed half-life; keys that reach zero
+// leave the list
+static void HotKeysDecay(long long now) {
+    if (!module_config.hotkeys_halflife) {
+        return;
     }
-    
-    if (expire < MIN_EXPIRE_MS || expire > MAX_EXPIRE_MS) {
-        return RedisModule_ReplyWithError(ctx, 
-            "ERR expire time must be between 1 second and 7 days");
+    long long periods = (now - hotkeys.last_decay) / module_config.hotkeys_halflife;
+    if (periods <= 0) {
+        return;
+    }
+    hotkeys.last_decay += periods * module_config.hotkeys_halflife;
+    int shift = periods < 32 ? (int)periods : 32;
+    for (int d = 0; d < HOTKEYS_DEPTH; d++) {
+        for (int w = 0; w < HOTKEYS_WIDTH; w++) {
+            hotkeys.sketch[d][w] = shift < 32 ? hotkeys.sketch[d][w] >> shift : 0;
+        }
     }
+    for (int i = 0; i < HOTKEYS_TOPK; i++) {
+        HotKey *hk = &hotkeys.top[i];
+        if (!hk->key) continue;
+        hk->count = shift < 32 ? hk->count >> shift : 0;
+        if (hk->count == 0) {
+            HotKeyFree(hk);
+            continue;
+        }
+        hk->stale_serves >>= shift;
+        hk->regen_grants >>= shift;
+    }
+}
 
-    // Set the main cache key
-    RedisModuleKey *k = RedisModule_OpenKey(ctx, key, REDISMODULE_WRITE);
-    if (!k) {
-        return RedisModule_ReplyWithError(ctx, "ERR failed to access key");
+// Counts one access. outcome is the read's GuardOutcome, or HOTKEYS_WRITE.
+static void HotKeysRecord(RedisModuleString *key, size_t outcome) {
+    if (!module_config.hotkeys) {
+        return;
     }
-    
-    if (RedisModule_StringSet(k, value) != REDISMODULE_OK) {
-        RedisModule_CloseKey(k);
-        return RedisModule_ReplyWithError(ctx, "ERR failed to set value");
+    HotKeysDecay(RedisModule_Milliseconds());
+
+    size_t len;
+    const char *ptr = RedisModule_StringPtrLen(key, &len);
+    uint64_t hash = HotKeyHash(ptr, len);
+    uint32_t h1 = (uint32_t)hash, h2 = (uint32_t)(hash >> 32) | 1;
+
+    // Conservative update: raise only the cells holding the minimum
+    uint32_t *cells[HOTKEYS_DEPTH];
+    uint32_t estimate = UINT32_MAX;
+    for (int d = 0; d < HOTKEYS_DEPTH; d++) {
+        cells[d] = &hotkeys.sketch[d][(h1 + (uint32_t)d * h2) & (HOTKEYS_WIDTH - 1)];
+        if (*cells[d] < estimate) estimate = *cells[d];
     }
-    
-    if (RedisModule_SetExpire(k, expire) != REDISMODULE_OK) {
-        RedisModule_CloseKey(k);
-        return RedisModule_ReplyWithError(ctx, "ERR failed to set expiration");
+    if (estimate < UINT32_MAX) {
+        for (int d = 0; d < HOTKEYS_DEPTH; d++) {
+            if (*cells[d] == estimate) (*cells[d])++;
+        }
+        estimate++;
     }
-    
-    RedisModule_CloseKey(k);
 
-    // Clean up regeneration lock
-    RedisModuleString *lockKey = CreateLockKey(ctx, key);
-    if (lockKey) {
-        RedisModuleKey *lock = RedisModule_OpenKey(ctx, lockKey, REDISMODULE_WRITE);
-        if (lock) {
-            if (RedisModule_KeyType(lock) != REDISMODULE_KEYTYPE_EMPTY) {
-                RedisModule_DeleteKey(lock);
-                LOG_DEBUG(ctx, "Regeneration lock released");
-            }
-            RedisModule_CloseKey(lock);
+    HotKey *hk = NULL, *coldest = NULL;
+    for (int i = 0; i < HOTKEYS_TOPK; i++) {
+        HotKey *cur = &hotkeys.top[i];
+        if (cur->key && cur->hash == hash && cur->len == len && memcmp(cur->key, ptr, len) == 0) {
+            hk = cur;
+            break;
         }
+        if (!coldest || !cur->key || (coldest->key && cur->count < coldest->count)) {
+            coldest = cur;
+        }
+    }
+    if (!hk) {
+        if (coldest->key && coldest->count >= estimate) {
+            return;
+        }
+        if (coldest->key) HotKeyFree(coldest);
+        hk = coldest;
+        hk->key = RedisModule_Alloc(len ? len : 1);
+        memcpy(hk->key, ptr, len);
+        hk->len = len;
+        hk->hash = hash;
     }
 
-    LOG_DEBUG(ctx, "Cache set successfully (expires in %lld ms)", expire);
-    return RedisModule_ReplyWithSimpleString(ctx, "OK");
+    hk->count = estimate;
+    if (outcome == GUARD_STALE) hk->stale_serves++;
+    if (outcome == GUARD_REGEN) hk->regen_grants++;
 }
 
-// Module info command for observability
-int CacheGuardInfoCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
-    REDISMODULE_NOT_USED(argv);
-    REDISMODULE_NOT_USED(argc);
-    
-    RedisModule_ReplyWithArray(ctx, 8);
-    
+// Bloom filters for negative caching: one scalable filter per key namespace
+// (the key up to a ':') holds every key that exists in the backing store.
+// Once enabled, cache.guard.get answers keys the filter has never seen as
+// missing without opening them. Applications load the filter with
+// cache.guard.bloom ADD before enabling it, and set/mset add what they write.
+// Filters live in this node's memory only; they are neither replicated nor
+// persisted, so after a restart lookups go to the keyspace until rebuilt.
+//
+// Each layer holds its capacity at its own error rate. When the newest layer
+// is full a twice larger one with half the error rate is added, so the
+// layers' false positive rates sum to less than the reserved one. A filter
+// that needs a layer past BLOOM_MAX_LAYERS or BLOOM_MAX_CAPACITY is
+// saturated: it stops taking keys and get no longer consults it, since
+// filling the last layer further would raise its rate without bound.
+#define BLOOM_MAX_LAYERS 16
+#define BLOOM_MAX_FILTERS 64
+#define BLOOM_MAX_CAPACITY 100000000LL  // Per layer
+#define BLOOM_MIN_ERROR 0.00001
+#define BLOOM_MAX_ERROR 0.25
+
+typedef struct BloomLayer {
+    uint64_t *bits;
+    uint64_t nbits;
+    int hashes;
+    long long capacity;
+    long long items;
+} BloomLayer;
+
+typedef struct BloomFilter {
+    BloomLayer layers[BLOOM_MAX_LAYERS];
+    int nlayers;
+    long long capacity;                 // Capacity of the first layer
+    double error_rate;                  // Bound on the false positive rate
+    int enabled;                        // Consulted by cache.guard.get
+    int saturated;                      // Out of layers; no longer consulted
+} BloomFilter;
+
+static RedisModuleDict *bloom_filters = NULL;
+
+// Layer i gets error_rate / 2^(i+1), with the optimal bit and hash counts
+static void BloomAddLayer(BloomFilter *bf) {
+    int i = bf->nlayers++;
+    BloomLayer *l = &bf->layers[i];
+    double p = bf->error_rate / (double)(2ULL << i);
+    l->capacity = bf->capacity << i;
+    l->nbits = ((uint64_t)ceil(l->capacity * -log(p) / (M_LN2 * M_LN2)) + 63) & ~63ULL;
+    l->hashes = (int)ceil(-log2(p));
+    l->bits = RedisModule_Calloc(l->nbits / 64, sizeof(uint64_t));
+}
+
+static BloomFilter *BloomFilterCreate(long long capacity, double errorRate) {
+    BloomFilter *bf = RedisModule_Calloc(1, sizeof(*bf));
+    bf->capacity = capacity;
+    bf->error_rate = errorRate;
+    BloomAddLayer(bf);
+    return bf;
+}
+
+static void BloomFilterFree(BloomFilter *bf) {
+    for (int i = 0; i < bf->nlayers; i++) {
+        RedisModule_Free(bf->layers[i].bits);
+    }
+    RedisModule_Free(bf);
+}
+
+static size_t BloomFilterBytes(const BloomFilter *bf) {
+    size_t bytes = sizeof(*bf);
+    for (int i = 0; i < bf->nlayers; i++) {
+        bytes += bf->layers[i].nbits / 8;
+    }
+    return bytes;
+}
+
+// Two independent hashes for double hashing: FNV-1a and its murmur finalizer
+static void BloomHash(const char *key, size_t len, uint64_t *h1, uint64_t *h2) {
+    uint64_t h = HotKeyHash(key, len);
+    *h1 = h;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    *h2 = h | 1;
+}
+
+static int BloomContains(const BloomFilter *bf, uint64_t h1, uint64_t h2) {
+    for (int i = 0; i < bf->nlayers; i++) {
+        const BloomLayer *l = &bf->layers[i];
+        int j;
+        for (j = 0; j < l->hashes; j++) {
+            uint64_t bit = (h1 + (uint64_t)j * h2) % l->nbits;
+            if (!(l->bits[bit >> 6] & (1ULL << (bit & 63)))) break;
+        }
+        if (j == l->hashes) return 1;
+    }
+    return 0;
+}
+
+// Keys already present are not counted again, so re-adding keeps the fill
+// (and the error rate) where it was
+static void BloomAdd(BloomFilter *bf, const char *key, size_t len) {
+    if (bf->saturated) {
+        return;
+    }
+    uint64_t h1, h2;
+    BloomHash(key, len, &h1, &h2);
+    if (BloomContains(bf, h1, h2)) {
+        return;
+    }
+    BloomLayer *l = &bf->layers[bf->nlayers - 1];
+    if (l->items >= l->capacity) {
+        if (bf->nlayers == BLOOM_MAX_LAYERS || l->capacity * 2 > BLOOM_MAX_CAPACITY) {
+            bf->saturated = 1;
+            return;
+        }
+        BloomAddLayer(bf);
+        l = &bf->layers[bf->nlayers - 1];
+    }
+    for (int j = 0; j < l->hashes; j++) {
+        uint64_t bit = (h1 + (uint64_t)j * h2) % l->nbits;
+        l->bits[bit >> 6] |= 1ULL << (bit & 63);
+    }
+    l->items++;
+}
+
+// The filter of the longest namespace the key belongs to, or NULL
+static BloomFilter *BloomFilterForKey(const char *key, size_t len) {
+    BloomFilter *found = NULL;
+    for (size_t i = 1; i < len; i++) {
+        if (key[i] != ':') continue;
+        BloomFilter *bf = RedisModule_DictGetC(bloom_filters, (void *)key, i, NULL);
+        if (bf) found = bf;
+    }
+    return found;
+}
+
+// True when the key's namespace has an enabled filter that never saw the key
+static int BloomDefinitelyAbsent(RedisModuleString *key) {
+    if (RedisModule_DictSize(bloom_filters) == 0) {
+        return 0;
+    }
+    size_t len;
+    const char *ptr = RedisModule_StringPtrLen(key, &len);
+    BloomFilter *bf = BloomFilterForKey(ptr, len);
+    if (!bf || !bf->enabled || bf->saturated) {
+        return 0;
+    }
+    uint64_t h1, h2;
+    BloomHash(ptr, len, &h1, &h2);
+    return !BloomContains(bf, h1, h2);
+}
+
+// Adds an existing key to its namespace's filter; returns 0 if there is none
+static int BloomRecordKey(RedisModuleString *key) {
+    if (RedisModule_DictSize(bloom_filters) == 0) {
+        return 0;
+    }
+    size_t len;
+    const char *ptr = RedisModule_StringPtrLen(key, &len);
+    BloomFilter *bf = BloomFilterForKey(ptr, len);
+    if (!bf) {
+        return 0;
+    }
+    BloomAdd(bf, ptr, len);
+    return 1;
+}
+
+// Tag index: cache.guard.set ... TAGS files a key under tags, and
+// cache.guard.invalidate drops (or marks stale) every key of a tag without
+// scanning the keyspace. The tags are stored in the entry itself as
+// NUL-terminated names, so RDB, AOF and replicas keep them. The index maps
+// db + tag to the tag's key names, and db + key to the tags it was filed
+// under, so keyspace notifications can unfile keys that are deleted,
+// expire, are evicted or get overwritten by other commands.
+#define MAX_TAGS 32
+#define DB_SCOPED_NAME_MAX (sizeof(int) + MAX_KEY_LENGTH)
+
+static RedisModuleDict *tag_index = NULL;   // db + tag -> dict of key names
+static RedisModuleDict *tagged_keys = NULL; // db + key -> tags it is filed under
+
+// A cache.guard.invalidate still working through its detached key set
+typedef struct TagInvalidation {
+    RedisModuleDict *keys;              // Key names not processed yet
+    int db;
+    int soft;
+    struct TagInvalidation *next;
+} TagInvalidation;
+
+static TagInvalidation *tag_invalidations = NULL;   // Oldest first
+
+// Name in a per-database dict: the database number followed by the name
+static size_t DbScopedName(int db, const char *ptr, size_t len, char *buf) {
+    memcpy(buf, &db, sizeof(db));
+    memcpy(buf + sizeof(db), ptr, len);
+    return sizeof(db) + len;
+}
+
+// Packs tag arguments into the stored form, dropping duplicates
+static const char *PackTags(RedisModuleCtx *ctx, RedisModuleString **argv, int argc,
+                            RedisModuleString **tags) {
+    if (argc > MAX_TAGS) {
+        return "ERR too many tags (max 32)";
+    }
+    char *buf = RedisModule_Alloc(argc * (MAX_KEY_LENGTH + 1));
+    size_t len = 0;
+    for (int i = 0; i < argc; i++) {
+        size_t tagLen;
+        const char *tag = RedisModule_StringPtrLen(argv[i], &tagLen);
+        if (tagLen == 0 || tagLen > MAX_KEY_LENGTH || memchr(tag, '\0', tagLen)) {
+            RedisModule_Free(buf);
+            return "ERR invalid tag";
+        }
+        int seen = 0;
+        for (int j = 0; j < i && !seen; j++) {
+            seen = RedisModule_StringCompare(argv[i], argv[j]) == 0;
+        }
+        if (!seen) {
+            memcpy(buf + len, tag, tagLen);
+            buf[len + tagLen] = '\0';
+            len += tagLen + 1;
+        }
+    }
+    *tags = RedisModule_CreateString(ctx, buf, len);
+    RedisModule_Free(buf);
+    return NULL;
+}
+
+// Checks tags in the stored form, as received by cache.guard.restore
+static int ValidPackedTags(RedisModuleString *tags) {
+    size_t len;
+    const char *p = RedisModule_StringPtrLen(tags, &len);
+    const char *end = p + len;
+    int count = 0;
+    if (len == 0 || end[-1] != '\0') {
+        return 0;
+    }
+    for (; p < end; p += strlen(p) + 1) {
+        size_t tagLen = strlen(p);
+        if (tagLen == 0 || tagLen > MAX_KEY_LENGTH || ++count > MAX_TAGS) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Unfiles a key from every tag it was filed under
+static void TagIndexRemove(int db, RedisModuleString *key) {
+    if (RedisModule_DictSize(tagged_keys) == 0) {
+        return;
+    }
+    size_t keyLen;
+    const char *keyPtr = RedisModule_StringPtrLen(key, &keyLen);
+    char name[DB_SCOPED_NAME_MAX];
+    RedisModuleString *tags = NULL;
+    if (RedisModule_DictDelC(tagged_keys, name, DbScopedName(db, keyPtr, keyLen, name),
+                             &tags) != REDISMODULE_OK) {
+        return;
+    }
+
+    size_t tagsLen;
+    const char *p = RedisModule_StringPtrLen(tags, &tagsLen);
+    for (const char *end = p + tagsLen; p < end; p += strlen(p) + 1) {
+        size_t len = DbScopedName(db, p, strlen(p), name);
+        RedisModuleDict *keys = RedisModule_DictGetC(tag_index, name, len, NULL);
+        if (!keys) {
+            continue;
+        }
+        RedisModule_DictDelC(keys, (void *)keyPtr, keyLen, NULL);
+        if (RedisModule_DictSize(keys) == 0) {
+            RedisModule_DictDelC(tag_index, name, len, NULL);
+            RedisModule_FreeDict(NULL, keys);
+        }
+    }
+    RedisModule_FreeString(NULL, tags);
+}
+
+// Files a key under tags (in the stored form), replacing its old filing
+static void TagIndexAdd(int db, RedisModuleString *key, RedisModuleString *tags) {
+    TagIndexRemove(db, key);
+
+    size_t keyLen;
+    const char *keyPtr = RedisModule_StringPtrLen(key, &keyLen);
+    char name[DB_SCOPED_NAME_MAX];
+    RedisModule_RetainString(NULL, tags);
+    RedisModule_DictSetC(tagged_keys, name, DbScopedName(db, keyPtr, keyLen, name), tags);
+
+    size_t tagsLen;
+    const char *p = RedisModule_StringPtrLen(tags, &tagsLen);
+    for (const char *end = p + tagsLen; p < end; p += strlen(p) + 1) {
+        size_t len = DbScopedName(db, p, strlen(p), name);
+        RedisModuleDict *keys = RedisModule_DictGetC(tag_index, name, len, NULL);
+        if (!keys) {
+            keys = RedisModule_CreateDict(NULL);
+            RedisModule_DictSetC(tag_index, name, len, keys);
+        }
+        RedisModule_DictReplaceC(keys, (void *)keyPtr, keyLen, NULL);
+    }
+}
+
+// Forgets every filing in db, or in all databases for -1
+static void TagIndexDropDb(int db) {
+    RedisModuleDictIter *it = RedisModule_DictIteratorStartC(tagged_keys, "^", NULL, 0);
+    char *name;
+    size_t len;
+    while ((name = RedisModule_DictNextC(it, &len, NULL)) != NULL) {
+        int keyDb;
+        memcpy(&keyDb, name, sizeof(keyDb));
+        if (db != -1 && keyDb != db) {
+            continue;
+        }
+        RedisModuleString *key = RedisModule_CreateString(NULL, name + sizeof(keyDb),
+                                                          len - sizeof(keyDb));
+        TagIndexRemove(keyDb, key);
+        RedisModule_DictIteratorReseekC(it, ">", name, len);
+        RedisModule_FreeString(NULL, key);
+    }
+    RedisModule_DictIteratorStop(it);
+
+    TagInvalidation **ip = &tag_invalidations;
+    while (*ip) {
+        TagInvalidation *inv = *ip;
+        if (db != -1 && inv->db != db) {
+            ip = &inv->next;
+            continue;
+        }
+        *ip = inv->next;
+        RedisModule_FreeDict(NULL, inv->keys);
+        RedisModule_Free(inv);
+    }
+}
+
+// A write replaced the value after an invalidation was issued: the new
+// value is not part of it
+static void TagInvalidationsForget(int db, RedisModuleString *key) {
+    size_t len;
+    const char *ptr = RedisModule_StringPtrLen(key, &len);
+    for (TagInvalidation *inv = tag_invalidations; inv; inv = inv->next) {
+        if (inv->db == db) {
+            RedisModule_DictDelC(inv->keys, (void *)ptr, len, NULL);
+        }
+    }
+}
+
+// Keyspace notifications: resyncs the filing of a tagged key from what the
+// key holds now. Other keys only matter when one of ours arrives under a
+// new name (RENAME, MOVE, RESTORE).
+static int TagIndexNotify(RedisModuleCtx *ctx, int type, const char *event, RedisModuleString *key) {
+    REDISMODULE_NOT_USED(type);
+    // Only these events can put a tagged entry under a key that is not filed
+    int arriving = strcmp(event, "rename_to") == 0 || strcmp(event, "move_to") == 0 ||
+                   strcmp(event, "restore") == 0;
+    if (!arriving && RedisModule_DictSize(tagged_keys) == 0) {
+        return REDISMODULE_OK;
+    }
+    int db = RedisModule_GetSelectedDb(ctx);
+    size_t keyLen;
+    const char *keyPtr = RedisModule_StringPtrLen(key, &keyLen);
+    if (keyLen > MAX_KEY_LENGTH) {
+        return REDISMODULE_OK;
+    }
+    char name[DB_SCOPED_NAME_MAX];
+    RedisModuleString *filed = RedisModule_DictGetC(tagged_keys, name,
+                                                    DbScopedName(db, keyPtr, keyLen, name), NULL);
+    if (!filed && !arriving) {
+        return REDISMODULE_OK;
+    }
+
+    RedisModuleKey *k = RedisModule_OpenKey(ctx, key, REDISMODULE_READ);
+    CacheGuardEntry *entry = k ? GetGuardEntry(k) : NULL;
+    RedisModuleString *tags = entry ? entry->tags : NULL;
+    if (tags != filed) {
+        if (tags) {
+            TagIndexAdd(db, key, tags);
+        } else {
+            TagIndexRemove(db, key);
+        }
+    }
+    if (k) {
+        RedisModule_CloseKey(k);
+    }
+    return REDISMODULE_OK;
+}
+
+// FLUSHDB and FLUSHALL delete keys without per-key notifications
+static void TagIndexFlushed(RedisModuleCtx *ctx, RedisModuleEvent eid, uint64_t subevent, void *data) {
+    REDISMODULE_NOT_USED(ctx);
+    REDISMODULE_NOT_USED(eid);
+    if (subevent == REDISMODULE_SUBEVENT_FLUSHDB_START) {
+        TagIndexDropDb(((RedisModuleFlushInfo *)data)->dbnum);
+    }
+}
+
+// SWAPDB: refiles the keys of both databases under the other number
+static void TagIndexSwapped(RedisModuleCtx *ctx, RedisModuleEvent eid, uint64_t subevent, void *data) {
+    REDISMODULE_NOT_USED(ctx);
+    REDISMODULE_NOT_USED(eid);
+    REDISMODULE_NOT_USED(subevent);
+    RedisModuleSwapDbInfo *info = data;
+    int first = info->dbnum_first, second = info->dbnum_second;
+
+    size_t n = 0, cap = 16;
+    struct { int db; RedisModuleString *key, *tags; } *moved = RedisModule_Alloc(cap * sizeof(*moved));
+    RedisModuleDictIter *it = RedisModule_DictIteratorStartC(tagged_keys, "^", NULL, 0);
+    char *name;
+    size_t len;
+    RedisModuleString *tags;
+    while ((name = RedisModule_DictNextC(it, &len, (void **)&tags)) != NULL) {
+        int db;
+        memcpy(&db, name, sizeof(db));
+        if (db != first && db != second) {
+            continue;
+        }
+        if (n == cap) {
+            cap *= 2;
+            moved = RedisModule_Realloc(moved, cap * sizeof(*moved));
+        }
+        moved[n].db = db;
+        moved[n].key = RedisModule_CreateString(NULL, name + sizeof(db), len - sizeof(db));
+        RedisModule_RetainString(NULL, tags);
+        moved[n].tags = tags;
+        n++;
+    }
+    RedisModule_DictIteratorStop(it);
+
+    for (size_t i = 0; i < n; i++) {
+        TagIndexRemove(moved[i].db, moved[i].key);
+    }
+    for (size_t i = 0; i < n; i++) {
+        TagIndexAdd(moved[i].db == first ? second : first, moved[i].key, moved[i].tags);
+        RedisModule_FreeString(NULL, moved[i].key);
+        RedisModule_FreeString(NULL, moved[i].tags);
+    }
+    RedisModule_Free(moved);
+
+    for (TagInvalidation *inv = tag_invalidations; inv; inv = inv->next) {
+        if (inv->db == first || inv->db == second) {
+            inv->db = inv->db == first ? second : first;
+        }
+    }
+}
+
+// Namespace generations: cache.guard.ns.bump invalidates a whole namespace
+// (the key up to a ':', as for Bloom filters) without touching its keys. A
+// namespace records the generation clock at its last bump, and an entry
+// stamped before a bump of any namespace it belongs to is outdated. Reads
+// then treat it as marked stale, or after a HARD bump as missing, and clean
+// it up on the spot. Replicas and AOF replay rebuild the table from the
+// propagated bumps; RDB saves and AOF rewrites store outdated entries in
+// their outdated form and loaded entries take the current clock.
+//
+// Entries live at most MAX_EXPIRE_MS, so older bumps no longer match any
+// entry and are pruned when the table fills up.
+#define NAMESPACE_MAX 1000000
+
+typedef struct Namespace {
+    unsigned long long soft_at;         // Clock at the last bump
+    unsigned long long hard_at;         // Clock at the last HARD bump
+    long long bumped_ms;                // Time of the last bump
+    long long generation;               // Number of bumps
+} Namespace;
+
+static RedisModuleDict *namespaces = NULL;
+
+// Whether the newest bump of a namespace the key belongs to postdates the
+// entry. Lease-only placeholders are never outdated.
+static int NamespaceOutdated(RedisModuleString *key, const CacheGuardEntry *entry) {
+    if (!entry || (entry->flags & ENTRY_FLAG_PENDING) || RedisModule_DictSize(namespaces) == 0) {
+        return NS_CURRENT;
+    }
+    size_t len;
+    const char *ptr = RedisModule_StringPtrLen(key, &len);
+    int outdated = NS_CURRENT;
+    for (size_t i = 1; i < len; i++) {
+        if (ptr[i] != ':') continue;
+        Namespace *ns = RedisModule_DictGetC(namespaces, (void *)ptr, i, NULL);
+        if (!ns) continue;
+        if (ns->hard_at > entry->generation) {
+            return NS_OUTDATED_HARD;
+        }
+        if (ns->soft_at > entry->generation) {
+            outdated = NS_OUTDATED;
+        }
+    }
+    return outdated;
+}
+
+// Drops bumps older than any entry can be; returns how many were dropped
+static long long NamespacesPrune(void) {
+    long long horizon = RedisModule_Milliseconds() - MAX_EXPIRE_MS - MAX_GRACE_PERIOD_MS;
+    long long pruned = 0;
+    RedisModuleDictIter *it = RedisModule_DictIteratorStartC(namespaces, "^", NULL, 0);
+    char *name;
+    size_t len;
+    Namespace *ns;
+    while ((name = RedisModule_DictNextC(it, &len, (void **)&ns)) != NULL) {
+        if (ns->bumped_ms >= horizon) {
+            continue;
+        }
+        RedisModule_DictDelC(namespaces, name, len, NULL);
+        RedisModule_Free(ns);
+        RedisModule_DictIteratorReseekC(it, ">", name, len);
+        pruned++;
+    }
+    RedisModule_DictIteratorStop(it);
+    return pruned;
+}
+
+// Per-call options for GuardLookupKey
+typedef struct GuardOptions {
+    long long gracePeriodMs;
+    long long leaseMs;          // Regeneration lease duration
+    int xfetch;                 // Probabilistic early recomputation
+    int lockOnMiss;             // Take a lease when the key is missing
+    int refreshAhead;           // Queue grace-window regenerations instead of granting them
+    int queue;                  // Leave grace-window and miss regenerations to claim workers
+    int raw;                    // Serve compressed values as stored
+    int chunked;                // Reply with values split into chunks
+} GuardOptions;
+
+// Result of GuardLookupKey. The key stays open so that value keeps pointing
+// into the stored entry (or string DMA buffer) until the caller has replied.
+typedef struct GuardLookup {
+    GuardOutcome outcome;
+    RedisModuleKey *key;
+    const char *value;
+    size_t valueLen;
+    long long retryAfterMs;     // Remaining lease time (or queued lease) for GUARD_BUSY
+    unsigned long long token;   // Fencing token for GUARD_REGEN
+    int compressed;             // value is an LZ4 payload to decode when replying
+    int chunked;                // Reply with the value as an array of chunks
+} GuardLookup;
+
+// Key name checks shared by every guard command; returns an error reply or NULL
+static const char *ValidateKeyName(RedisModuleString *key) {
+    if (!key) {
+        return "ERR invalid key";
+    }
+    size_t keyLen;
+    RedisModule_StringPtrLen(key, &keyLen);
+    if (keyLen == 0) {
+        return "ERR empty key not allowed";
+    }
+    if (keyLen > MAX_KEY_LENGTH) {
+        return "ERR key too long";
+    }
+    return NULL;
+}
+
+// Lease used when the caller gave no LEASE: the configured default, or the
+// grace period. Either is capped at max_lock_duration so that a long grace
+// window still hands out a lease instead of none at all.
+static long long DefaultLeaseMs(long long gracePeriodMs) {
+    long long lease = module_config.default_lease ? module_config.default_lease : gracePeriodMs;
+    return lease < module_config.max_lock_duration ? lease : module_config.max_lock_duration;
+}
+
+static const char *ParseGracePeriod(RedisModuleString *arg, long long *gracePeriodMs) {
+    if (RedisModule_StringToLongLong(arg, gracePeriodMs) != REDISMODULE_OK) {
+        return "ERR invalid grace period format";
+    }
+    if (*gracePeriodMs < MIN_GRACE_PERIOD_MS || *gracePeriodMs > MAX_GRACE_PERIOD_MS) {
+        return "ERR grace period must be between 100ms and 24 hours";
+    }
+    return NULL;
+}
+
+// Adaptive grace: for every key prefix the module learns how long clients take
+// between a regeneration grant and the cache.guard.set that ends it. Calls
+// without an explicit grace get max(EWMA, p95) of those times plus
+// grace_margin percent, so the rebuilt value lands before the old one expires
+// without starting rebuilds much earlier than needed.
+#define GRACE_SAMPLES 64                // Recent regeneration times kept per prefix
+#define GRACE_EWMA_ALPHA 0.2
+#define MAX_GRACE_PREFIXES 1024         // Further prefixes use default_grace_period
+
+typedef struct GracePrefix {
+    double ewma_ms;
+    long long samples[GRACE_SAMPLES];   // Ring buffer, ms
+    unsigned long long count;           // Samples recorded so far
+    long long p95_ms;                   // Recomputed on every sample
+    long long grace_ms;                 // Grace handed to calls without one
+} GracePrefix;
+
+static RedisModuleDict *grace_prefixes = NULL;
+
+// Length of the first grace_prefix_depth ':'-separated segments of the key.
+// The last segment never counts, so "user:42" and "user:43" share "user" and
+// keys without a ':' share the empty prefix.
+static size_t GracePrefixLen(const char *key, size_t len) {
+    size_t prefixLen = 0;
+    int depth = 0;
+    for (size_t i = 0; i < len && depth < module_config.grace_prefix_depth; i++) {
+        if (key[i] == ':') {
+            prefixLen = i;
+            depth++;
+        }
+    }
+    return prefixLen;
+}
+
+static int CompareLongLong(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+static long long ClampGracePeriod(long long ms) {
+    if (ms < MIN_GRACE_PERIOD_MS) return MIN_GRACE_PERIOD_MS;
+    if (ms > MAX_GRACE_PERIOD_MS) return MAX_GRACE_PERIOD_MS;
+    return ms;
+}
+
+static void GracePrefixUpdate(GracePrefix *gp) {
+    long long sorted[GRACE_SAMPLES];
+    size_t n = gp->count < GRACE_SAMPLES ? (size_t)gp->count : GRACE_SAMPLES;
+    memcpy(sorted, gp->samples, n * sizeof(sorted[0]));
+    qsort(sorted, n, sizeof(sorted[0]), CompareLongLong);
+    gp->p95_ms = sorted[(n * 95 + 99) / 100 - 1];
+
+    double base = gp->ewma_ms > (double)gp->p95_ms ? gp->ewma_ms : (double)gp->p95_ms;
+    gp->grace_ms = ClampGracePeriod((long long)ceil(base * (100 + module_config.grace_margin) / 100));
+}
+
+// Records how long a regeneration of this key took
+static void RecordRegenTime(RedisModuleString *key, long long ms) {
+    size_t len;
+    const char *ptr = RedisModule_StringPtrLen(key, &len);
+    size_t prefixLen = GracePrefixLen(ptr, len);
+
+    GracePrefix *gp = RedisModule_DictGetC(grace_prefixes, (void *)ptr, prefixLen, NULL);
+    if (!gp) {
+        if (RedisModule_DictSize(grace_prefixes) >= MAX_GRACE_PREFIXES) {
+            return;
+        }
+        gp = RedisModule_Calloc(1, sizeof(*gp));
+        gp->ewma_ms = (double)ms;
+        RedisModule_DictSetC(grace_prefixes, (void *)ptr, prefixLen, gp);
+    }
+
+    gp->ewma_ms += GRACE_EWMA_ALPHA * ((double)ms - gp->ewma_ms);
+    gp->samples[gp->count % GRACE_SAMPLES] = ms;
+    gp->count++;
+    GracePrefixUpdate(gp);
+}
+
+// Grace for a call that gave none: learned for the key's prefix, or
+// default_grace_period until a regeneration has been measured
+static long long AdaptiveGracePeriod(RedisModuleString *key) {
+    size_t len;
+    const char *ptr = RedisModule_StringPtrLen(key, &len);
+    GracePrefix *gp = RedisModule_DictGetC(grace_prefixes, (void *)ptr,
+                                           GracePrefixLen(ptr, len), NULL);
+    return gp ? gp->grace_ms : module_config.default_grace_period;
+}
+
+// A numeric argument or AUTO in the grace position, as opposed to an option
+static int IsGraceArgument(RedisModuleString *arg) {
+    long long ignored;
+    return strcasecmp(RedisModule_StringPtrLen(arg, NULL), "AUTO") == 0 ||
+           RedisModule_StringToLongLong(arg, &ignored) == REDISMODULE_OK;
+}
+
+// Recomputes every learned grace after grace_margin changes
+static void GracePrefixesRefresh(void) {
+    RedisModuleDictIter *it = RedisModule_DictIteratorStartC(grace_prefixes, "^", NULL, 0);
+    GracePrefix *gp;
+    while (RedisModule_DictNextC(it, NULL, (void **)&gp) != NULL) {
+        GracePrefixUpdate(gp);
+    }
+    RedisModule_DictIteratorStop(it);
+}
+
+// Forgets every learned prefix, e.g. after grace_prefix_depth changes
+static void GracePrefixesReset(void) {
+    RedisModuleDictIter *it = RedisModule_DictIteratorStartC(grace_prefixes, "^", NULL, 0);
+    GracePrefix *gp;
+    while (RedisModule_DictNextC(it, NULL, (void **)&gp) != NULL) {
+        RedisModule_Free(gp);
+    }
+    RedisModule_DictIteratorStop(it);
+    RedisModule_FreeDict(NULL, grace_prefixes);
+    grace_prefixes = RedisModule_CreateDict(NULL);
+}
+
+// Accepts a grace in ms or AUTO; *gracePeriodMs is 0 for AUTO
+static const char *ParseGraceOrAuto(RedisModuleString *arg, long long *gracePeriodMs) {
+    if (strcasecmp(RedisModule_StringPtrLen(arg, NULL), "AUTO") == 0) {
+        *gracePeriodMs = 0;
+        return NULL;
+    }
+    return ParseGracePeriod(arg, gracePeriodMs);
+}
+
+// XFetch (optimal probabilistic early expiration): recompute once
+// now - delta * beta * ln(rand) reaches the expiry. The chance rises as
+// expiry approaches, and slow-to-compute values start refreshing earlier.
+static int InEarlyRecomputeWindow(const CacheGuardEntry *entry, mstime_t ttl) {
+    if (ttl <= 0) {
+        return 1;
+    }
+    double gap = -(double)entry->delta * module_config.xfetch_beta * log(RandomUnit());
+    return (double)ttl <= gap;
+}
+
+// Lock-on-miss: takes the regeneration lease for a missing key by writing a
+// lease-only placeholder entry that expires with the lease. Later misses see
+// the placeholder and are told to retry instead of all hitting the backend.
+static const char *TakeMissLease(RedisModuleCtx *ctx, RedisModuleString *key,
+                                 long long leaseMs, GuardLookup *res) {
+    if (res->key) {
+        RedisModule_CloseKey(res->key);
+    }
+    RedisModuleKey *k = res->key = RedisModule_OpenKey(ctx, key, REDISMODULE_READ | REDISMODULE_WRITE);
+    if (!k) {
+        return "ERR failed to access key";
+    }
+
+    CacheGuardEntry *entry = GetGuardEntry(k);
+    if (!entry) {
+        entry = CacheGuardEntryCreate();
+        entry->flags = ENTRY_FLAG_PENDING;
+        if (RedisModule_ModuleTypeSetValue(k, CacheGuardType, entry) != REDISMODULE_OK) {
+            CacheGuardEntryFree(entry);
+            return "ERR failed to set value";
+        }
+    }
+
+    if (TryAcquireLease(ctx, entry, leaseMs)) {
+        RedisModule_SetExpire(k, leaseMs);
+        LOG_DEBUG(ctx, "Cache miss - lock acquired, requesting regeneration");
+        res->outcome = GUARD_REGEN;
+        res->token = entry->token;
+        guard_stats.regen_grants++;
+    } else {
+        res->outcome = GUARD_BUSY;
+        res->retryAfterMs = entry->lease_deadline - RedisModule_Milliseconds();
+    }
+    return NULL;
+}
+
+// Refresh-ahead: appends a regeneration job for key to refresh_stream, so a
+// worker rebuilds the value while readers keep getting the current one. The
+// lease just granted deduplicates jobs: no other job is queued for the key
+// until the worker writes with the job's token or the lease runs out.
+// Returns 0 if the job could not be added; the caller then regenerates inline.
+static int EnqueueRefresh(RedisModuleCtx *ctx, RedisModuleString *key,
+                          unsigned long long token, long long leaseMs) {
+    RedisModuleCallReply *reply;
+    if (module_config.refresh_stream_maxlen > 0) {
+        reply = RedisModule_Call(ctx, "XADD", "!ccclccsclcl", module_config.refresh_stream,
+                                 "MAXLEN", "~", module_config.refresh_stream_maxlen, "*",
+                                 "key", key, "token", (long long)token, "lease_ms", leaseMs);
+    } else {
+        reply = RedisModule_Call(ctx, "XADD", "!cccsclcl", module_config.refresh_stream, "*",
+                                 "key", key, "token", (long long)token, "lease_ms", leaseMs);
+    }
+    int added = reply && RedisModule_CallReplyType(reply) != REDISMODULE_REPLY_ERROR;
+    if (reply) {
+        RedisModule_FreeCallReply(reply);
+    }
+    if (!added) {
+        LOG_WARNING(ctx, "Failed to add refresh job to %s, regenerating inline",
+                    module_config.refresh_stream);
+        guard_stats.refresh_failures++;
+        return 0;
+    }
+    LOG_DEBUG(ctx, "Refresh job queued (token %llu)", token);
+    guard_stats.refresh_jobs++;
+    return 1;
+}
+
+// The job stream is written from inside get, but no key spec of get can
+// declare it. In Redis Cluster it hashes to its own slot, which may live on
+// another node or move away, so refresh-ahead is refused there; the
+// regeneration queue is node-local and works instead.
+static int RefreshAheadAllowed(RedisModuleCtx *ctx) {
+    return !(RedisModule_GetContextFlags(ctx) & REDISMODULE_CTX_FLAGS_CLUSTER);
+}
+
+// Regeneration queue: with QUEUE (or regen_queue), cache.guard.get hands no
+// regeneration to readers. Grace-window hits get the current value, misses
+// get BUSYREGEN, and the key is queued once for cache.guard.claim. A claim
+// takes the key's lease for the worker; the write that ends the lease
+// (set, mset, setmissing) completes the job, and jobs whose lease runs out
+// first go back to the front of the queue. Like leases, the queue is local
+// to this node and is not persisted.
+#define REGEN_QUEUE_MAX 1000000
+#define MAX_CLAIM_COUNT 1000
+
+typedef struct RegenJob {
+    RedisModuleString *key;
+    int db;
+    int claimed;
+    long long deadline;                 // Lease deadline while claimed
+    struct RegenJob *prev, *next;       // Place in the queued or claimed list
+} RegenJob;
+
+typedef struct RegenJobList {
+    RegenJob *head, *tail;
+    size_t len;
+} RegenJobList;
+
+// A cache.guard.claim blocked until jobs for its database are queued
+typedef struct ClaimWaiter {
+    RedisModuleBlockedClient *bc;
+    int db;
+    long long count;
+    long long leaseMs;                  // 0 = per-key default
+    struct ClaimWaiter *next;
+} ClaimWaiter;
+
+// Keys handed to a blocked claim; its reply callback takes their leases
+typedef struct ClaimBatch {
+    int n;
+    long long leaseMs;
+    RedisModuleString *keys[];
+} ClaimBatch;
+
+static struct {
+    RedisModuleDict *jobs;              // db + key name -> RegenJob
+    RegenJobList queued;                // Oldest first
+    RegenJobList claimed;
+    ClaimWaiter *waiters;               // Oldest first
+    RedisModuleTimerID timer;           // Fires at timer_at to requeue lapsed claims
+    long long timer_at;
+} regen_queue;
+
+static void RegenJobListPush(RegenJobList *list, RegenJob *job, int front) {
+    job->prev = front ? NULL : list->tail;
+    job->next = front ? list->head : NULL;
+    if (job->prev) job->prev->next = job; else list->head = job;
+    if (job->next) job->next->prev = job; else list->tail = job;
+    list->len++;
+}
+
+static void RegenJobListRemove(RegenJobList *list, RegenJob *job) {
+    if (job->prev) job->prev->next = job->next; else list->head = job->next;
+    if (job->next) job->next->prev = job->prev; else list->tail = job->prev;
+    job->prev = job->next = NULL;
+    list->len--;
+}
+
+static size_t RegenJobName(int db, RedisModuleString *key, char *buf) {
+    size_t len;
+    const char *ptr = RedisModule_StringPtrLen(key, &len);
+    return DbScopedName(db, ptr, len, buf);
+}
+
+static RegenJob *RegenJobFind(int db, RedisModuleString *key) {
+    char name[DB_SCOPED_NAME_MAX];
+    size_t len = RegenJobName(db, key, name);
+    return RedisModule_DictGetC(regen_queue.jobs, name, len, NULL);
+}
+
+static void RegenJobDelete(RegenJob *job) {
+    char name[DB_SCOPED_NAME_MAX];
+    size_t len = RegenJobName(job->db, job->key, name);
+    RedisModule_DictDelC(regen_queue.jobs, name, len, NULL);
+    RegenJobListRemove(job->claimed ? &regen_queue.claimed : &regen_queue.queued, job);
+    RedisModule_FreeString(NULL, job->key);
+    RedisModule_Free(job);
+}
+
+static void RegenJobClaim(RegenJob *job, long long deadline) {
+    if (!job->claimed) {
+        RegenJobListRemove(&regen_queue.queued, job);
+        RegenJobListPush(&regen_queue.claimed, job, 0);
+        job->claimed = 1;
+    }
+    job->deadline = deadline;
+}
+
+// Lease for a claimed key: LEASE if the claim gave one, else what a
+// cache.guard.get with the key's learned grace would take
+static long long ClaimLeaseMs(RedisModuleString *key, long long leaseMs) {
+    return leaseMs ? leaseMs : DefaultLeaseMs(AdaptiveGracePeriod(key));
+}
+
+static void RegenQueueTimer(RedisModuleCtx *ctx, void *data);
+
+// Keeps one timer armed for the earliest claimed deadline
+static void RegenQueueScheduleTimer(RedisModuleCtx *ctx) {
+    long long earliest = 0;
+    for (RegenJob *job = regen_queue.claimed.head; job; job = job->next) {
+        if (!earliest || job->deadline < earliest) {
+            earliest = job->deadline;
+        }
+    }
+    if (!earliest || (regen_queue.timer && regen_queue.timer_at <= earliest)) {
+        return;
+    }
+    if (regen_queue.timer) {
+        RedisModule_StopTimer(ctx, regen_queue.timer, NULL);
+    }
+    long long now = RedisModule_Milliseconds();
+    regen_queue.timer = RedisModule_CreateTimer(ctx, earliest > now ? earliest - now : 1,
+                                                RegenQueueTimer, NULL);
+    regen_queue.timer_at = earliest;
+}
+
+// Hands queued jobs to blocked claims, oldest claim first. Handed-out jobs
+// count as claimed from here on, so a claim whose client goes away before
+// its reply is requeued like any other lapsed lease.
+static void RegenQueueDispatch(RedisModuleCtx *ctx) {
+    long long now = RedisModule_Milliseconds();
+    ClaimWaiter **wp = &regen_queue.waiters;
+    while (*wp && regen_queue.queued.len) {
+        ClaimWaiter *w = *wp;
+        ClaimBatch *batch = NULL;
+        RegenJob *next;
+        for (RegenJob *job = regen_queue.queued.head; job && (!batch || batch->n < w->count); job = next) {
+            next = job->next;
+            if (job->db != w->db) {
+                continue;
+            }
+            if (!batch) {
+                batch = RedisModule_Alloc(sizeof(*batch) + w->count * sizeof(RedisModuleString *));
+                batch->n = 0;
+                batch->leaseMs = w->leaseMs;
+            }
+            batch->keys[batch->n++] = RedisModule_CreateStringFromString(NULL, job->key);
+            RegenJobClaim(job, now + ClaimLeaseMs(job->key, w->leaseMs));
+        }
+        if (!batch) {
+            wp = &w->next;
+            continue;
+        }
+        *wp = w->next;
+        RedisModule_UnblockClient(w->bc, batch);
+        RedisModule_Free(w);
+    }
+    RegenQueueScheduleTimer(ctx);
+}
+
+// Puts claimed jobs whose lease ran out without a write back at the front of
+// the queue, in claim order
+static void RegenQueueTimer(RedisModuleCtx *ctx, void *data) {
+    REDISMODULE_NOT_USED(data);
+    regen_queue.timer = 0;
+    long long now = RedisModule_Milliseconds();
+    RegenJob *prev;
+    for (RegenJob *job = regen_queue.claimed.tail; job; job = prev) {
+        prev = job->prev;
+        if (job->deadline > now) {
+            continue;
+        }
+        RegenJobListRemove(&regen_queue.claimed, job);
+        RegenJobListPush(&regen_queue.queued, job, 1);
+        job->claimed = 0;
+        job->deadline = 0;
+        guard_stats.queue_requeues++;
+    }
+    RegenQueueDispatch(ctx);
+}
+
+// Queues key for regeneration unless it is already queued or claimed.
+// Returns 0 when the queue is full; the caller then falls back to handing
+// the regeneration to the reader.
+static int RegenQueuePush(RedisModuleCtx *ctx, RedisModuleString *key) {
+    int db = RedisModule_GetSelectedDb(ctx);
+    if (RegenJobFind(db, key)) {
+        return 1;
+    }
+    if (RedisModule_DictSize(regen_queue.jobs) >= REGEN_QUEUE_MAX) {
+        LOG_WARNING(ctx, "Regeneration queue full, regenerating inline");
+        return 0;
+    }
+
+    RegenJob *job = RedisModule_Calloc(1, sizeof(*job));
+    job->key = RedisModule_CreateStringFromString(NULL, key);
+    job->db = db;
+    char name[DB_SCOPED_NAME_MAX];
+    size_t len = RegenJobName(db, key, name);
+    RedisModule_DictSetC(regen_queue.jobs, name, len, job);
+    RegenJobListPush(&regen_queue.queued, job, 0);
+    guard_stats.queue_jobs++;
+    LOG_DEBUG(ctx, "Regeneration job queued");
+    RegenQueueDispatch(ctx);
+    return 1;
+}
+
+// A write ended the key's regeneration: drops its job, queued or claimed
+static void RegenQueueComplete(RedisModuleCtx *ctx, RedisModuleString *key) {
+    if (RedisModule_DictSize(regen_queue.jobs) == 0) {
+        return;
+    }
+    RegenJob *job = RegenJobFind(RedisModule_GetSelectedDb(ctx), key);
+    if (job) {
+        RegenJobDelete(job);
+    }
+}
+
+static void ClaimWaiterRemove(RedisModuleBlockedClient *bc) {
+    for (ClaimWaiter **wp = &regen_queue.waiters; *wp; wp = &(*wp)->next) {
+        if ((*wp)->bc == bc) {
+            ClaimWaiter *w = *wp;
+            *wp = w->next;
+            RedisModule_Free(w);
+            return;
+        }
+    }
+}
+
+// Takes the regeneration lease on a claimed key for the worker: a lease-only
+// placeholder for a missing key, the entry's lease, or the sibling lock key
+// of a plain string. Returns the fencing token, or 0 when the key no longer
+// needs a worker (its lease is held elsewhere, or it became a tombstone or
+// some other type).
+static unsigned long long ClaimJobLease(RedisModuleCtx *ctx, RedisModuleString *key, long long leaseMs) {
+    RedisModuleKey *k = RedisModule_OpenKey(ctx, key, REDISMODULE_READ | REDISMODULE_WRITE);
+    if (!k) {
+        return 0;
+    }
+
+    unsigned long long token = 0;
+    int created = 0;
+    CacheGuardEntry *entry = GetGuardEntry(k);
+    if (RedisModule_KeyType(k) == REDISMODULE_KEYTYPE_EMPTY) {
+        entry = CacheGuardEntryCreate();
+        entry->flags = ENTRY_FLAG_PENDING;
+        if (RedisModule_ModuleTypeSetValue(k, CacheGuardType, entry) != REDISMODULE_OK) {
+            CacheGuardEntryFree(entry);
+            entry = NULL;
+        }
+        created = entry != NULL;
+    }
+
+    if (entry && !(entry->flags & ENTRY_FLAG_MISSING)) {
+        if (TryAcquireLease(ctx, entry, leaseMs)) {
+            token = entry->token;
+            if (entry->flags & ENTRY_FLAG_PENDING) {
+                RedisModule_SetExpire(k, leaseMs);
+            }
+        } else if (created) {
+            RedisModule_DeleteKey(k);
+        }
+    } else if (!entry && RedisModule_KeyType(k) == REDISMODULE_KEYTYPE_STRING) {
+        if (!TryAcquireLock(ctx, key, leaseMs, &token)) {
+            token = 0;
+        }
+    }
+    RedisModule_CloseKey(k);
+    return token;
+}
+
+static void GuardLookupRelease(GuardLookup *res) {
+    if (res->key) {
+        RedisModule_CloseKey(res->key);
+        res->key = NULL;
+    }
+}
+
+// Points res->value at the entry's stored bytes. Compressed values are
+// decoded when replying, unless raw asks for the stored payload.
+static void GuardLookupSetValue(GuardLookup *res, const CacheGuardEntry *entry, int raw) {
+    res->value = RedisModule_StringPtrLen(entry->value, &res->valueLen);
+    res->compressed = (entry->flags & ENTRY_FLAG_LZ4) && !raw;
+}
+
+static int MarkEntryStale(RedisModuleCtx *ctx, RedisModuleString *key);
+
+// Deletes an entry a HARD namespace bump outdated. The DEL is propagated:
+// a replica that was not attached at the time of the bump, or loaded after
+// the namespace was pruned, has no table entry to derive it from.
+static void DeleteOutdatedEntry(RedisModuleCtx *ctx, RedisModuleString *key) {
+    RedisModuleKey *k = RedisModule_OpenKey(ctx, key, REDISMODULE_READ | REDISMODULE_WRITE);
+    if (!k) {
+        return;
+    }
+    RedisModule_DeleteKey(k);
+    RedisModule_CloseKey(k);
+    TagIndexRemove(RedisModule_GetSelectedDb(ctx), key);
+    RedisModule_Replicate(ctx, "DEL", "s", key);
+    guard_stats.outdated_deletes++;
+}
+
+// Runs the fresh/grace/lock decision for one key. The key is opened
+// read-only; only a grace-window hit on a native entry reopens it for
+// writing to take the lease. Returns an error reply string on failure,
+// NULL on success (call GuardLookupRelease after replying).
+static const char *GuardLookupKey(RedisModuleCtx *ctx, RedisModuleString *key,
+                                  const GuardOptions *opts, GuardLookup *res) {
+    long long gracePeriodMs = opts->gracePeriodMs;
+    long long leaseMs = opts->leaseMs;
+    memset(res, 0, sizeof(*res));
+    res->chunked = opts->chunked;
+
+    if (BloomDefinitelyAbsent(key)) {
+        LOG_DEBUG(ctx, "Known missing - not in the namespace Bloom filter");
+        res->outcome = GUARD_MISSING;
+        guard_stats.missing_hits++;
+        guard_stats.bloom_rejects++;
+        return NULL;
+    }
+
+    RedisModuleKey *k = RedisModule_OpenKey(ctx, key, REDISMODULE_READ);
+    if (!k) {
+        LOG_WARNING(ctx, "Failed to open key");
+        return "ERR failed to access key";
+    }
+
+    // Entries outdated by a namespace bump are marked stale, or deleted after
+    // a HARD bump, before anything else looks at them
+    int outdated = NamespaceOutdated(key, GetGuardEntry(k));
+    if (outdated) {
+        RedisModule_CloseKey(k);
+        if (outdated == NS_OUTDATED_HARD) {
+            DeleteOutdatedEntry(ctx, key);
+        } else if (MarkEntryStale(ctx, key)) {
+            RedisModule_Replicate(ctx, "cache.guard.stale", "s", key);
+        }
+        k = RedisModule_OpenKey(ctx, key, REDISMODULE_READ);
+        if (!k) {
+            return "ERR failed to access key";
+        }
+    }
+    res->key = k;
+
+    if (RedisModule_KeyType(k) == REDISMODULE_KEYTYPE_EMPTY) {
+        LOG_DEBUG(ctx, "Cache miss - key not found");
+        res->outcome = GUARD_MISS;
+        guard_stats.cold_misses++;
+        if (opts->queue && RegenQueuePush(ctx, key)) {
+            res->outcome = GUARD_BUSY;
+            res->retryAfterMs = leaseMs;
+            return NULL;
+        }
+        if (opts->lockOnMiss && ValidLeaseDuration(leaseMs)) {
+            return TakeMissLease(ctx, key, leaseMs, res);
+        }
+        return NULL;
+    }
+
+    CacheGuardEntry *entry = GetGuardEntry(k);
+    if (entry && (entry->flags & ENTRY_FLAG_MISSING)) {
+        // Tombstones are served until they expire, grace window or not
+        LOG_DEBUG(ctx, "Known missing - tombstone");
+        res->outcome = GUARD_MISSING;
+        guard_stats.missing_hits++;
+        return NULL;
+    }
+    if (entry && (entry->flags & ENTRY_FLAG_PENDING)) {
+        // Someone else took the miss lease. Callers that did not opt in keep
+        // the plain miss semantics.
+        res->outcome = GUARD_MISS;
+        guard_stats.cold_misses++;
+        if (!opts->lockOnMiss && !opts->queue) {
+            return NULL;
+        }
+        long long remaining = entry->lease_deadline - RedisModule_Milliseconds();
+        if (remaining > 0) {
+            LOG_DEBUG(ctx, "Cache miss - regeneration in progress, retry in %lld ms", remaining);
+            res->outcome = GUARD_BUSY;
+            res->retryAfterMs = remaining;
+            guard_stats.lock_contention++;
+            return NULL;
+        }
+        if (opts->queue && RegenQueuePush(ctx, key)) {
+            res->outcome = GUARD_BUSY;
+            res->retryAfterMs = leaseMs;
+            return NULL;
+        }
+        return ValidLeaseDuration(leaseMs) ? TakeMissLease(ctx, key, leaseMs, res) : NULL;
+    }
+
+    if (entry) {
+        mstime_t ttl = entry->expire_at - RedisModule_Milliseconds();
+        // XFetch needs a known compute time; without one the grace window
+        // applies. Values marked stale are in it whatever their TTL.
+        int inWindow = (entry->flags & ENTRY_FLAG_STALE) ||
+            ((opts->xfetch && entry->delta > 0) ?
+             InEarlyRecomputeWindow(entry, ttl) : ttl <= gracePeriodMs);
+        if (!inWindow) {
+            LOG_DEBUG(ctx, "Cache hit - returning fresh data (TTL: %lld ms)", ttl);
+            res->outcome = GUARD_FRESH;
+            guard_stats.fresh_hits++;
+            GuardLookupSetValue(res, entry, opts->raw);
+            return NULL;
+        }
+
+        // Grace window: reopen for writing so the lease update is a proper
+        // keyspace modification. The entry itself stays in place.
+        LOG_DEBUG(ctx, "Cache in grace period (TTL: %lld ms, grace: %lld ms)", ttl, gracePeriodMs);
+        if (opts->queue && (entry->lease_deadline > RedisModule_Milliseconds() ||
+                            RegenQueuePush(ctx, key))) {
+            // A claim worker rebuilds it (or a lease holder already is)
+            res->outcome = GUARD_STALE;
+            guard_stats.stale_serves++;
+            GuardLookupSetValue(res, entry, opts->raw);
+            return NULL;
+        }
+        RedisModule_CloseKey(k);
+        k = res->key = RedisModule_OpenKey(ctx, key, REDISMODULE_READ | REDISMODULE_WRITE);
+        entry = k ? GetGuardEntry(k) : NULL;
+        if (!entry) {
+            return "ERR failed to access key";
+        }
+
+        if (TryAcquireLease(ctx, entry, leaseMs)) {
+            if (opts->refreshAhead && EnqueueRefresh(ctx, key, entry->token, leaseMs)) {
+                // A worker rebuilds it; this caller gets the current value
+                res->outcome = GUARD_STALE;
+                guard_stats.stale_serves++;
+                GuardLookupSetValue(res, entry, opts->raw);
+                return NULL;
+            }
+            LOG_DEBUG(ctx, "Lock acquired - requesting regeneration");
+            res->outcome = GUARD_REGEN;
+            res->token = entry->token;
+            guard_stats.regen_grants++;
+        } else {
+            LOG_DEBUG(ctx, "Lock held by another client - returning stale data");
+            res->outcome = GUARD_STALE;
+            guard_stats.stale_serves++;
+            GuardLookupSetValue(res, entry, opts->raw);
+            return NULL;
+        }
+        return NULL;
+    }
+
+    // Plain string values (written before the native type existed, or by
+    // plain SET) keep using the sibling lock key.
+    if (RedisModule_KeyType(k) != REDISMODULE_KEYTYPE_STRING) {
+        return "ERR key contains non-string data";
+    }
+
+    mstime_t ttl = RedisModule_GetExpire(k);
+    
+    // Get the value with error checking
+    res->value = RedisModule_StringDMA(k, &res->valueLen, REDISMODULE_READ);
+    if (!res->value) {
+        return "ERR failed to read value";
+    }
+
+    if (ttl == REDISMODULE_NO_EXPIRE || ttl > gracePeriodMs) {
+        // Cache valid and NOT within grace period
+        LOG_DEBUG(ctx, "Cache hit - returning fresh data (TTL: %lld ms)", ttl);
+        res->outcome = GUARD_FRESH;
+        guard_stats.fresh_hits++;
+        return NULL;
+    }
+
+    // Cache within grace period or expired: try to acquire regeneration lock.
+    // The lock lives in its own key, so the value buffer stays valid while the
+    // value key remains open.
+    LOG_DEBUG(ctx, "Cache in grace period (TTL: %lld ms, grace: %lld ms)", ttl, gracePeriodMs);
+    if (opts->queue && RegenQueuePush(ctx, key)) {
+        res->outcome = GUARD_STALE;
+        guard_stats.stale_serves++;
+        return NULL;
+    }
+
+    if (TryAcquireLock(ctx, key, leaseMs, &res->token)) {
+        if (opts->refreshAhead && EnqueueRefresh(ctx, key, res->token, leaseMs)) {
+            res->outcome = GUARD_STALE;
+            res->token = 0;
+            guard_stats.stale_serves++;
+            return NULL;
+        }
+        LOG_DEBUG(ctx, "Lock acquired - requesting regeneration");
+        res->outcome = GUARD_REGEN;
+        res->value = NULL;
+        res->valueLen = 0;
+        guard_stats.regen_grants++;
+    } else {
+        LOG_DEBUG(ctx, "Lock held by another client - returning stale data");
+        res->outcome = GUARD_STALE;
+        guard_stats.stale_serves++;
+    }
+    return NULL;
+}
+
+// Replies with len bytes of decoded value, chunked or as one bulk string
+static void ReplyWithValueBuffer(RedisModuleCtx *ctx, const char *value, size_t len, int chunked) {
+    if (!chunked) {
+        RedisModule_ReplyWithStringBuffer(ctx, value, len);
+        return;
+    }
+    RedisModule_ReplyWithArray(ctx, (len + VALUE_CHUNK_SIZE - 1) / VALUE_CHUNK_SIZE);
+    for (size_t off = 0; off < len; off += VALUE_CHUNK_SIZE) {
+        size_t n = len - off < VALUE_CHUNK_SIZE ? len - off : VALUE_CHUNK_SIZE;
+        RedisModule_ReplyWithStringBuffer(ctx, value + off, n);
+    }
+}
+
+// Replies with the looked-up value as one bulk string or, when chunked, as an
+// array of bulk strings of up to VALUE_CHUNK_SIZE bytes. Chunked replies of
+// compressed values decode one chunk at a time, so no buffer of the full
+// value is allocated (except for single-block payloads from older versions).
+// Chunking bounds memory only: the whole value is still decoded and queued
+// here, in one call on the main thread.
+static void ReplyWithGuardValue(RedisModuleCtx *ctx, const GuardLookup *res) {
+    if (!res->compressed) {
+        ReplyWithValueBuffer(ctx, res->value, res->valueLen, res->chunked);
+        return;
+    }
+
+    Lz4Reader reader;
+    long long len = Lz4ReaderInit(&reader, res->value, res->valueLen);
+    if (len < 0) {
+        RedisModule_ReplyWithError(ctx, "ERR failed to decompress value");
+        return;
+    }
+    if (!res->chunked || !reader.framed) {
+        // Single-block payloads can only be decoded whole
+        char *buf = RedisModule_Alloc(len ? len : 1);
+        if (Lz4ReaderRange(&reader, 0, len, buf) == 0) {
+            ReplyWithValueBuffer(ctx, buf, len, res->chunked);
+        } else {
+            RedisModule_ReplyWithError(ctx, "ERR failed to decompress value");
+        }
+        RedisModule_Free(buf);
+        return;
+    }
+
+    RedisModule_ReplyWithArray(ctx, (len + VALUE_CHUNK_SIZE - 1) / VALUE_CHUNK_SIZE);
+    unsigned char *buf = RedisModule_Alloc(VALUE_CHUNK_SIZE);
+    while (reader.remaining > 0) {
+        size_t n = Lz4ReaderChunkLen(&reader);
+        if (Lz4ReaderNext(&reader, buf) == 0) {
+            RedisModule_ReplyWithStringBuffer(ctx, (const char *)buf, n);
+        } else {
+            // The array length is already sent: fill it with errors
+            RedisModule_ReplyWithError(ctx, "ERR failed to decompress value");
+            Lz4ReaderSkip(&reader);
+        }
+    }
+    RedisModule_Free(buf);
+}
+
+// Replies with a [status, payload] pair: the value for fresh/stale, the
+// fencing token for regen, the retry delay for busy, and null otherwise
+// (miss, missing).
+static void ReplyWithGuardStatus(RedisModuleCtx *ctx, const GuardLookup *res) {
+    RedisModule_ReplyWithArray(ctx, 2);
+    RedisModule_ReplyWithSimpleString(ctx, GuardOutcomeNames[res->outcome]);
+    if (res->value) {
+        ReplyWithGuardValue(ctx, res);
+    } else if (res->outcome == GUARD_BUSY) {
+        RedisModule_ReplyWithLongLong(ctx, res->retryAfterMs);
+    } else if (res->outcome == GUARD_REGEN) {
+        RedisModule_ReplyWithLongLong(ctx, (long long)res->token);
+    } else {
+        RedisModule_ReplyWithNull(ctx);
+    }
+}
+
+// Replies to cache.guard.get for a finished lookup: the [status, payload]
+// pair with WITHSTATUS, otherwise the value, an error, or null when the
+// caller should rebuild.
+static void ReplyWithGuardLookup(RedisModuleCtx *ctx, const GuardLookup *res, int withStatus) {
+    if (withStatus) {
+        ReplyWithGuardStatus(ctx, res);
+    } else if (res->value) {
+        ReplyWithGuardValue(ctx, res);
+    } else if (res->outcome == GUARD_BUSY) {
+        char msg[96];
+        snprintf(msg, sizeof(msg), "BUSYREGEN key is being regenerated, retry after %lld ms",
+                 res->retryAfterMs);
+        RedisModule_ReplyWithError(ctx, msg);
+    } else if (res->outcome == GUARD_MISSING) {
+        RedisModule_ReplyWithError(ctx, "MISSING key is known not to exist");
+    } else {
+        RedisModule_ReplyWithNull(ctx);
+    }
+}
+
+// Options of a blocked cache.guard.get, kept as its private data
+typedef struct GuardWait {
+    GuardOptions opts;
+    int withStatus;
+} GuardWait;
+
+// Reply callback for cache.guard.get ... WAIT, run when cache.guard.set or
+// setmissing signals the key. Re-runs the lookup with the original options,
+// so the waiter gets what a fresh get would: the value, a tombstone, or a
+// lease if the value is already in its grace window or the miss lease
+// lapsed. Returning REDISMODULE_ERR keeps the client blocked while another
+// client still holds the miss lease.
+static int CacheGuardWaitReply(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    REDISMODULE_NOT_USED(argv);
+    REDISMODULE_NOT_USED(argc);
+
+    RedisModuleString *key = RedisModule_GetBlockedClientReadyKey(ctx);
+    GuardWait *wait = RedisModule_GetBlockedClientPrivateData(ctx);
+    GuardLookup res;
+    const char *err = GuardLookupKey(ctx, key, &wait->opts, &res);
+    if (err) {
+        RedisModule_ReplyWithError(ctx, err);
+    } else if (res.outcome == GUARD_BUSY) {
+        GuardLookupRelease(&res);
+        return REDISMODULE_ERR;
+    } else {
+        ReplyWithGuardLookup(ctx, &res, wait->withStatus);
+    }
+    GuardLookupRelease(&res);
+    return REDISMODULE_OK;
+}
+
+static void CacheGuardWaitFree(RedisModuleCtx *ctx, void *privdata) {
+    REDISMODULE_NOT_USED(ctx);
+    RedisModule_Free(privdata);
+}
+
+static int CacheGuardWaitTimeout(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    REDISMODULE_NOT_USED(argv);
+    REDISMODULE_NOT_USED(argc);
+    LOG_DEBUG(ctx, "Wait for regeneration timed out");
+    return RedisModule_ReplyWithNull(ctx);
+}
+
+// Enhanced GET command with comprehensive validation.
+// Runs without AutoMemory: the value key is opened read-only and every reply
+// is served straight from the stored buffer, so hits on uncompressed values
+// never copy the value.
+// Only the grace window touches the keyspace for writing (the lease).
+int CacheGuardGetCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc < 2) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    long long startUs = MonotonicMicros();
+
+    RedisModuleString *key = argv[1];
+    const char *err = ValidateKeyName(key);
+    if (err) {
+        return RedisModule_ReplyWithError(ctx, err);
+    }
+    
+    // The grace period is optional: options start right after the key when
+    // it is left out, and the grace learned for the key's prefix is used
+    GuardOptions opts = {
+        .xfetch = module_config.xfetch,
+        .lockOnMiss = module_config.lock_on_miss,
+        .refreshAhead = module_config.refresh_ahead,
+        .queue = module_config.regen_queue
+    };
+    int firstOpt = 2;
+    if (argc > 2 && IsGraceArgument(argv[2])) {
+        if ((err = ParseGraceOrAuto(argv[2], &opts.gracePeriodMs)) != NULL) {
+            return RedisModule_ReplyWithError(ctx, err);
+        }
+        firstOpt = 3;
+    }
+
+    long long waitMs = 0;
+    int withStatus = 0;
+    for (int i = firstOpt; i < argc; i++) {
+        const char *opt = RedisModule_StringPtrLen(argv[i], NULL);
+        if (strcasecmp(opt, "XFETCH") == 0) {
+            opts.xfetch = 1;
+        } else if (strcasecmp(opt, "WITHSTATUS") == 0) {
+            withStatus = 1;
+        } else if (strcasecmp(opt, "RAW") == 0) {
+            opts.raw = 1;
+        } else if (strcasecmp(opt, "CHUNKED") == 0) {
+            opts.chunked = 1;
+        } else if (strcasecmp(opt, "LEASE") == 0 && i + 1 < argc) {
+            if (RedisModule_StringToLongLong(argv[++i], &opts.leaseMs) != REDISMODULE_OK ||
+                !ValidLeaseDuration(opts.leaseMs)) {
+                return RedisModule_ReplyWithError(ctx, "ERR lease must be between 100ms and max_lock_duration");
+            }
+        } else if (strcasecmp(opt, "LOCKMISS") == 0) {
+            opts.lockOnMiss = 1;
+        } else if (strcasecmp(opt, "REFRESH") == 0) {
+            if (!RefreshAheadAllowed(ctx)) {
+                return RedisModule_ReplyWithError(ctx, "ERR REFRESH is not supported in Redis Cluster, use QUEUE");
+            }
+            opts.refreshAhead = 1;
+        } else if (strcasecmp(opt, "QUEUE") == 0) {
+            opts.queue = 1;
+        } else if (strcasecmp(opt, "WAIT") == 0 && i + 1 < argc) {
+            if (RedisModule_StringToLongLong(argv[++i], &waitMs) != REDISMODULE_OK ||
+                waitMs < 1 || waitMs > MAX_GRACE_PERIOD_MS) {
+                return RedisModule_ReplyWithError(ctx, "ERR wait timeout must be between 1ms and 24 hours");
+            }
+            // Waiting only makes sense if concurrent misses share one lease
+            opts.lockOnMiss = 1;
+        } else {
+            return RedisModule_ReplyWithError(ctx, "ERR syntax error");
+        }
+    }
+    if (!opts.gracePeriodMs) {
+        opts.gracePeriodMs = AdaptiveGracePeriod(key);
+    }
+    if (!opts.leaseMs) {
+        opts.leaseMs = DefaultLeaseMs(opts.gracePeriodMs);
+    }
+
+    GuardLookup res;
+    if ((err = GuardLookupKey(ctx, key, &opts, &res)) != NULL) {
+        GuardLookupRelease(&res);
+        return RedisModule_ReplyWithError(ctx, err);
+    }
+    HotKeysRecord(key, res.outcome);
+
+    // Park the client until cache.guard.set signals this key. Clients that
+    // cannot block (MULTI, scripts) get the BUSYREGEN reply instead.
+    int blockDenied = RedisModule_GetContextFlags(ctx) &
+        (REDISMODULE_CTX_FLAGS_MULTI | REDISMODULE_CTX_FLAGS_LUA | REDISMODULE_CTX_FLAGS_DENY_BLOCKING);
+    if (res.outcome == GUARD_BUSY && waitMs > 0 && !blockDenied) {
+        GuardLookupRelease(&res);
+        LOG_DEBUG(ctx, "Regeneration in progress - waiting up to %lld ms", waitMs);
+        GuardWait *wait = RedisModule_Alloc(sizeof(*wait));
+        wait->opts = opts;
+        wait->withStatus = withStatus;
+        RedisModule_BlockClientOnKeys(ctx, CacheGuardWaitReply, CacheGuardWaitTimeout,
+                                      CacheGuardWaitFree, waitMs, &key, 1, wait);
+        LatencyRecord(res.outcome, startUs);
+        return REDISMODULE_OK;
+    }
+
+    // Regeneration grants and misses both tell the caller to rebuild
+    ReplyWithGuardLookup(ctx, &res, withStatus);
+    GuardLookupRelease(&res);
+    LatencyRecord(res.outcome, startUs);
+    return REDISMODULE_OK;
+}
+
+// Batched GET: cache.guard.mget <grace_ms|AUTO> key [key ...]
+// Replies with one [status, payload] pair per key (see ReplyWithGuardStatus).
+// Lock decisions are the same as cache.guard.get.
+int CacheGuardMGetCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc < 3) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    GuardOptions opts = {
+        .xfetch = module_config.xfetch,
+        .lockOnMiss = module_config.lock_on_miss,
+        .refreshAhead = module_config.refresh_ahead,
+        .queue = module_config.regen_queue
+    };
+    const char *err = ParseGraceOrAuto(argv[1], &opts.gracePeriodMs);
+    if (err) {
+        return RedisModule_ReplyWithError(ctx, err);
+    }
+    int adaptive = opts.gracePeriodMs == 0;
+    opts.leaseMs = adaptive ? 0 : DefaultLeaseMs(opts.gracePeriodMs);
+
+    // Validate every key up front so a bad name doesn't leave some locks taken
+    for (int i = 2; i < argc; i++) {
+        if ((err = ValidateKeyName(argv[i])) != NULL) {
+            return RedisModule_ReplyWithError(ctx, err);
+        }
+    }
+
+    RedisModule_ReplyWithArray(ctx, argc - 2);
+    for (int i = 2; i < argc; i++) {
+        if (adaptive) {
+            opts.gracePeriodMs = AdaptiveGracePeriod(argv[i]);
+            opts.leaseMs = DefaultLeaseMs(opts.gracePeriodMs);
+        }
+
+        GuardLookup res;
+        if ((err = GuardLookupKey(ctx, argv[i], &opts, &res)) != NULL) {
+            RedisModule_ReplyWithError(ctx, err);
+            GuardLookupRelease(&res);
+            continue;
+        }
+        HotKeysRecord(argv[i], res.outcome);
+
+        ReplyWithGuardStatus(ctx, &res);
+        GuardLookupRelease(&res);
+    }
+    return REDISMODULE_OK;
+}
+
+// Range read: cache.guard.getrange <key> <offset> <len>
+// Replies with up to len bytes of the value starting at offset (an empty
+// string past the end), or null when the key is missing or only holds a
+// lock-on-miss placeholder. Unlike cache.guard.get it never takes a lease.
+// Uncompressed values are sliced straight from the stored buffer; compressed
+// ones decode only the chunks the range covers.
+int CacheGuardGetRangeCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc != 4) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    const char *err = ValidateKeyName(argv[1]);
+    if (err) {
+        return RedisModule_ReplyWithError(ctx, err);
+    }
+    long long offset, count;
+    if (RedisModule_StringToLongLong(argv[2], &offset) != REDISMODULE_OK ||
+        RedisModule_StringToLongLong(argv[3], &count) != REDISMODULE_OK ||
+        offset < 0 || count < 0) {
+        return RedisModule_ReplyWithError(ctx, "ERR offset and length must be non-negative integers");
+    }
+
+    RedisModuleKey *k = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+    if (!k) {
+        return RedisModule_ReplyWithError(ctx, "ERR failed to access key");
+    }
+
+    GuardLookup res = { .key = k };
+    CacheGuardEntry *entry = GetGuardEntry(k);
+    if (entry && entry->value && NamespaceOutdated(argv[1], entry) != NS_OUTDATED_HARD) {
+        GuardLookupSetValue(&res, entry, 0);
+    } else if (!entry && RedisModule_KeyType(k) == REDISMODULE_KEYTYPE_STRING) {
+        res.value = RedisModule_StringDMA(k, &res.valueLen, REDISMODULE_READ);
+    } else if (!entry && RedisModule_KeyType(k) != REDISMODULE_KEYTYPE_EMPTY) {
+        GuardLookupRelease(&res);
+        return RedisModule_ReplyWithError(ctx, "ERR key contains non-string data");
+    }
+    if (!res.value) {
+        GuardLookupRelease(&res);
+        return RedisModule_ReplyWithNull(ctx);
+    }
+
+    Lz4Reader reader;
+    long long total = res.compressed ? Lz4ReaderInit(&reader, res.value, res.valueLen) :
+                                       (long long)res.valueLen;
+    if (total < 0) {
+        GuardLookupRelease(&res);
+        return RedisModule_ReplyWithError(ctx, "ERR failed to decompress value");
+    }
+    if (offset > total) offset = total;
+    if (count > total - offset) count = total - offset;
+
+    if (!res.compressed) {
+        RedisModule_ReplyWithStringBuffer(ctx, res.value + offset, count);
+    } else {
+        char *buf = RedisModule_Alloc(count ? count : 1);
+        if (Lz4ReaderRange(&reader, offset, count, buf) == 0) {
+            RedisModule_ReplyWithStringBuffer(ctx, buf, count);
+        } else {
+            RedisModule_ReplyWithError(ctx, "ERR failed to decompress value");
+        }
+        RedisModule_Free(buf);
+    }
+    GuardLookupRelease(&res);
+    return REDISMODULE_OK;
+}
+
+static const char *ValidateValue(RedisModuleString *value) {
+    if (!value) {
+        return "ERR invalid key or value";
+    }
+    // Validate value length (prevent excessive memory usage)
+    size_t valueLen;
+    RedisModule_StringPtrLen(value, &valueLen);
+    if (valueLen > MAX_VALUE_SIZE) {
+        return "ERR value too large";
+    }
+    return NULL;
+}
+
+#define MAX_JITTER_PCT 50
+#define EXPIRY_SECOND_SLOTS 3600        // Expiries up to an hour ahead, per second
+#define EXPIRY_MINUTE_SLOTS 1440        // Expiries up to a day ahead, per minute
+
+// Expiry schedule: how many values written so far expire in each upcoming
+// second and minute. Each slot is tagged with the absolute second (minute)
+// it counts, so a slot whose time has passed is simply reused. Writes go to
+// the second ring when they expire within the hour, to the minute ring when
+// within the day. Overwritten and deleted entries are not subtracted.
+typedef struct ExpirySlot {
+    long long at;
+    unsigned long long count;
+} ExpirySlot;
+
+static ExpirySlot expiry_seconds[EXPIRY_SECOND_SLOTS];
+static ExpirySlot expiry_minutes[EXPIRY_MINUTE_SLOTS];
+
+static void ExpiryRecord(long long expireAtMs) {
+    long long now = RedisModule_Milliseconds() / 1000, at = expireAtMs / 1000;
+    ExpirySlot *slot;
+    if (at - now < EXPIRY_SECOND_SLOTS) {
+        slot = &expiry_seconds[at % EXPIRY_SECOND_SLOTS];
+    } else if ((at /= 60) - now / 60 < EXPIRY_MINUTE_SLOTS) {
+        slot = &expiry_minutes[at % EXPIRY_MINUTE_SLOTS];
+    } else {
+        return;
+    }
+    if (slot->at != at) {
+        slot->at = at;
+        slot->count = 0;
+    }
+    slot->count++;
+}
+
+static unsigned long long ExpiryCount(const ExpirySlot *ring, int slots, long long at) {
+    const ExpirySlot *slot = &ring[at % slots];
+    return slot->at == at ? slot->count : 0;
+}
+
+// Values expiring in each of the n periods of period seconds from now on.
+// Periods of a minute or more add up both rings.
+static void ExpirySchedule(long long period, int n, unsigned long long *counts) {
+    long long now = RedisModule_Milliseconds() / 1000;
+    long long start = period >= 60 ? now / 60 * 60 : now;
+    for (int i = 0; i < n; i++) {
+        long long from = start + i * period;
+        counts[i] = 0;
+        for (long long sec = from < now ? now : from; sec < from + period && sec - now < EXPIRY_SECOND_SLOTS; sec++) {
+            counts[i] += ExpiryCount(expiry_seconds, EXPIRY_SECOND_SLOTS, sec);
+        }
+        for (long long min = from / 60; period >= 60 && min < (from + period) / 60; min++) {
+            counts[i] += ExpiryCount(expiry_minutes, EXPIRY_MINUTE_SLOTS, min);
+        }
+    }
+}
+
+static const char *ParseJitter(RedisModuleString *arg, long long *pct) {
+    if (RedisModule_StringToLongLong(arg, pct) != REDISMODULE_OK ||
+        *pct < 0 || *pct > MAX_JITTER_PCT) {
+        return "ERR jitter must be between 0 and 50 percent";
+    }
+    return NULL;
+}
+
+// Shortens expire by a uniformly random share of up to pct percent, so that
+// keys written together don't all reach their grace window together. Expiry
+// only ever moves earlier, never past what the caller asked for. The cut
+// leaves at least MIN_EXPIRE_MS beyond the key's grace, so a jittered value
+// is never written already inside its grace window; shorter expiries are
+// not jittered. *jittered tells whether it was (see JitterRecord).
+static long long ApplyJitter(RedisModuleString *key, long long expire, long long pct, int *jittered) {
+    *jittered = 0;
+    if (pct <= 0) {
+        return expire;
+    }
+    long long range = (long long)(expire * pct / 100.0);
+    long long room = expire - MIN_EXPIRE_MS - AdaptiveGracePeriod(key);
+    if (range > room) {
+        range = room;
+    }
+    if (range <= 0) {
+        return expire;
+    }
+    *jittered = 1;
+    return expire - (long long)(range * (1.0 - RandomUnit()));
+}
+
+// Counts a jittered expiry once the write that used it is stored, so writes
+// rejected for a stale token don't count
+static void JitterRecord(int jittered) {
+    if (jittered) {
+        guard_stats.jittered_sets++;
+    }
+}
+
+static const char *ParseExpireTime(RedisModuleString *arg, long long *expire) {
+    if (RedisModule_StringToLongLong(arg, expire) != REDISMODULE_OK) {
+        return "ERR invalid expire time format";
+    }
+    if (*expire < MIN_EXPIRE_MS || *expire > MAX_EXPIRE_MS) {
+        return "ERR expire time must be between 1 second and 7 days";
+    }
+    return NULL;
+}
+
+// Reads the fencing token held by a plain string value's lock key (0 if none)
+static unsigned long long ReadLockKeyToken(RedisModuleCtx *ctx, RedisModuleString *key) {
+    RedisModuleString *lockKey = CreateLockKey(ctx, key);
+    if (!lockKey) {
+        return 0;
+    }
+    long long token = 0;
+    RedisModuleKey *lock = RedisModule_OpenKey(ctx, lockKey, REDISMODULE_READ);
+    if (lock) {
+        if (RedisModule_KeyType(lock) == REDISMODULE_KEYTYPE_STRING) {
+            size_t len;
+            const char *ptr = RedisModule_StringDMA(lock, &len, REDISMODULE_READ);
+            RedisModuleString *str = RedisModule_CreateString(ctx, ptr, len);
+            if (RedisModule_StringToLongLong(str, &token) != REDISMODULE_OK || token < 0) {
+                token = 0;
+            }
+            RedisModule_FreeString(ctx, str);
+        }
+        RedisModule_CloseKey(lock);
+    }
+    RedisModule_FreeString(ctx, lockKey);
+    return (unsigned long long)token;
+}
+
+// Replicas and the AOF get the final entry with its absolute expiry, token
+// and tags. Lease state (and any legacy lock key) stays local to the primary.
+static void ReplicateGuardedEntry(RedisModuleCtx *ctx, RedisModuleString *key,
+                                  const CacheGuardEntry *entry) {
+    if (entry->tags) {
+        if (entry->flags & ENTRY_FLAG_MISSING) {
+            RedisModule_Replicate(ctx, "cache.guard.restore", "slcclclccs", key, entry->expire_at, "",
+                                  "DELTA", entry->delta, "TOKEN", (long long)entry->token, "MISSING",
+                                  "TAGS", entry->tags);
+        } else if (entry->flags & ENTRY_FLAG_LZ4) {
+            RedisModule_Replicate(ctx, "cache.guard.restore", "slsclclccs", key, entry->expire_at,
+                                  entry->value, "DELTA", entry->delta, "TOKEN", (long long)entry->token,
+                                  "LZ4", "TAGS", entry->tags);
+        } else {
+            RedisModule_Replicate(ctx, "cache.guard.restore", "slsclclcs", key, entry->expire_at,
+                                  entry->value, "DELTA", entry->delta, "TOKEN", (long long)entry->token,
+                                  "TAGS", entry->tags);
+        }
+    } else if (entry->flags & ENTRY_FLAG_MISSING) {
+        RedisModule_Replicate(ctx, "cache.guard.restore", "slcclclc", key, entry->expire_at, "",
+                              "DELTA", entry->delta, "TOKEN", (long long)entry->token, "MISSING");
+    } else if (entry->flags & ENTRY_FLAG_LZ4) {
+        RedisModule_Replicate(ctx, "cache.guard.restore", "slsclclc", key, entry->expire_at,
+                              entry->value, "DELTA", entry->delta, "TOKEN", (long long)entry->token,
+                              "LZ4");
+    } else {
+        RedisModule_Replicate(ctx, "cache.guard.restore", "slsclcl", key, entry->expire_at,
+                              entry->value, "DELTA", entry->delta, "TOKEN", (long long)entry->token);
+    }
+}
+
+// Writes a validated value as a native entry and clears its lease. A NULL
+// value writes a tombstone (cache.guard.setmissing) instead.
+// delta is the compute time reported by the client, or -1 to measure it from
+// the lease grant when the write ends an active lease.
+// token is the fencing token the writer was granted, or 0 for an unfenced
+// write; unfenced writes take a new token so in-flight lease holders lose.
+// tags (in the stored form) replace the entry's tags; NULL keeps them.
+// *hadStringValue tells the caller a plain string was replaced, which may
+// still have a sibling lock key to release.
+static const char *StoreGuardedValue(RedisModuleCtx *ctx, RedisModuleString *key,
+                                     RedisModuleString *value, long long expire,
+                                     long long delta, unsigned long long token,
+                                     RedisModuleString *tags, int *hadStringValue) {
+    RedisModuleKey *k = RedisModule_OpenKey(ctx, key, REDISMODULE_READ | REDISMODULE_WRITE);
+    if (!k) {
+        return "ERR failed to access key";
+    }
+
+    *hadStringValue = RedisModule_KeyType(k) == REDISMODULE_KEYTYPE_STRING;
+    CacheGuardEntry *entry = GetGuardEntry(k);
+
+    // Reject writers whose lease was superseded before anything changes
+    if (token) {
+        unsigned long long current = entry ? entry->token :
+            *hadStringValue ? ReadLockKeyToken(ctx, key) : 0;
+        if (token < current) {
+            RedisModule_CloseKey(k);
+            guard_stats.fenced_writes++;
+            LOG_DEBUG(ctx, "Write fenced (token %llu, current %llu)", token, current);
+            return "STALETOKEN write rejected, a newer lease token was issued";
+        }
+    }
+
+    // Overwrite native entries in place; this also releases their lease
+    if (entry) {
+        if (entry->value) RedisModule_FreeString(NULL, entry->value);
+        entry->value = NULL;
+        entry->flags &= ~(ENTRY_FLAGS_NO_VALUE | ENTRY_FLAG_STALE);
+    } else {
+        entry = CacheGuardEntryCreate();
+        if (RedisModule_ModuleTypeSetValue(k, CacheGuardType, entry) != REDISMODULE_OK) {
+            CacheGuardEntryFree(entry);
+            RedisModule_CloseKey(k);
+            return "ERR failed to set value";
+        }
+    }
+
+    long long now = RedisModule_Milliseconds();
+    if (entry->lease_deadline > now) {
+        if (delta < 0) {
+            delta = now - entry->lease_granted_at;
+        }
+        guard_stats.lock_releases++;
+    }
+    // The lease holder's own write is measured even after its lease lapsed,
+    // so slow rebuilds still raise the learned grace
+    if (entry->lease_granted_at &&
+        (entry->lease_deadline > now || (token && token == entry->token))) {
+        RecordRegenTime(key, now - entry->lease_granted_at);
+    }
+    if (delta >= 0) {
+        entry->delta = delta;
+    }
+
+    // Large values are stored (and replicated) compressed when that pays off
+    RedisModuleString *compressed = value ? CompressValue(value) : NULL;
+    if (!value) {
+        entry->flags = (entry->flags & ~ENTRY_FLAG_LZ4) | ENTRY_FLAG_MISSING;
+    } else if (compressed) {
+        entry->value = compressed;
+        entry->flags |= ENTRY_FLAG_LZ4;
+    } else {
+        RedisModule_RetainString(NULL, value);
+        entry->value = value;
+        entry->flags &= ~ENTRY_FLAG_LZ4;
+    }
+    entry->expire_at = now + expire;
+    if (!token) {
+        entry->token = NextLeaseToken();
+    } else if (token > entry->token) {
+        entry->token = token;
+    }
+    entry->lease_holder = 0;
+    entry->lease_granted_at = 0;
+    entry->lease_deadline = 0;
+    entry->generation = ns_clock;
+    if (tags) {
+        if (entry->tags) RedisModule_FreeString(NULL, entry->tags);
+        RedisModule_RetainString(NULL, tags);
+        entry->tags = tags;
+    }
+    
+    if (RedisModule_SetExpire(k, expire) != REDISMODULE_OK) {
+        RedisModule_CloseKey(k);
+        return "ERR failed to set expiration";
+    }
+    
+    ReplicateGuardedEntry(ctx, key, entry);
+
+    // Also refiles kept tags, in case an invalidation detached the key's sets
+    int db = RedisModule_GetSelectedDb(ctx);
+    if (entry->tags) {
+        TagIndexAdd(db, key, entry->tags);
+    }
+    if (tag_invalidations) {
+        TagInvalidationsForget(db, key);
+    }
+    RedisModule_CloseKey(k);
+    if (value) {
+        guard_stats.sets++;
+        BloomRecordKey(key);
+        ExpiryRecord(now + expire);
+    } else {
+        guard_stats.tombstone_sets++;
+    }
+    HotKeysRecord(key, HOTKEYS_WRITE);
+    RegenQueueComplete(ctx, key);
+
+    // Wake clients blocked in cache.guard.get ... WAIT on this key
+    RedisModule_SignalKeyAsReady(ctx, key);
+    return NULL;
+}
+
+// Deletes the sibling lock key of a plain string value, if one exists
+static void ReleaseLockKey(RedisModuleCtx *ctx, RedisModuleString *key) {
+    RedisModuleString *lockKey = CreateLockKey(ctx, key);
+    if (!lockKey) {
+        return;
+    }
+    RedisModuleKey *lock = RedisModule_OpenKey(ctx, lockKey, REDISMODULE_WRITE);
+    if (lock) {
+        if (RedisModule_KeyType(lock) != REDISMODULE_KEYTYPE_EMPTY) {
+            RedisModule_DeleteKey(lock);
+            guard_stats.lock_releases++;
+            LOG_DEBUG(ctx, "Regeneration lock released");
+        }
+        RedisModule_CloseKey(lock);
+    }
+    RedisModule_FreeString(ctx, lockKey);
+}
+
+// Enhanced SET command with validation and cleanup
+int CacheGuardSetCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc < 4) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    RedisModule_AutoMemory(ctx);
+
+    long long startUs = MonotonicMicros();
+    RedisModuleString *key = argv[1];
+    RedisModuleString *value = argv[2];
+    
+    // Validate key, value and expiration time
+    const char *err = ValidateKeyName(key);
+    if (!err) err = ValidateValue(value);
+    if (err) {
+        return RedisModule_ReplyWithError(ctx, err);
+    }
+    
+    long long expire;
+    if ((err = ParseExpireTime(argv[3], &expire)) != NULL) {
+        return RedisModule_ReplyWithError(ctx, err);
+    }
+
+    long long delta = -1;
+    long long token = 0;
+    long long jitter = module_config.default_jitter;
+    RedisModuleString *tags = NULL;
+    for (int i = 4; i < argc; i++) {
+        const char *opt = RedisModule_StringPtrLen(argv[i], NULL);
+        if (strcasecmp(opt, "DELTA") == 0 && i + 1 < argc) {
+            if (RedisModule_StringToLongLong(argv[++i], &delta) != REDISMODULE_OK ||
+                delta < 0 || delta > MAX_EXPIRE_MS) {
+                return RedisModule_ReplyWithError(ctx, "ERR invalid delta");
+            }
+        } else if (strcasecmp(opt, "JITTER") == 0 && i + 1 < argc) {
+            if ((err = ParseJitter(argv[++i], &jitter)) != NULL) {
+                return RedisModule_ReplyWithError(ctx, err);
+            }
+        } else if (strcasecmp(opt, "TOKEN") == 0 && i + 1 < argc) {
+            if (RedisModule_StringToLongLong(argv[++i], &token) != REDISMODULE_OK || token < 1) {
+                return RedisModule_ReplyWithError(ctx, "ERR invalid token");
+            }
+        } else if (strcasecmp(opt, "TAGS") == 0 && i + 1 < argc) {
+            // Takes the rest of the arguments, so it has to come last
+            if ((err = PackTags(ctx, argv + i + 1, argc - i - 1, &tags)) != NULL) {
+                return RedisModule_ReplyWithError(ctx, err);
+            }
+            break;
+        } else {
+            return RedisModule_ReplyWithError(ctx, "ERR syntax error");
+        }
+    }
+
+    int hadStringValue, jittered;
+    if ((err = StoreGuardedValue(ctx, key, value, ApplyJitter(key, expire, jitter, &jittered), delta,
+                                 (unsigned long long)token, tags, &hadStringValue)) != NULL) {
+        return RedisModule_ReplyWithError(ctx, err);
+    }
+    JitterRecord(jittered);
+
+    // Clean up regeneration lock left by a string value
+    if (hadStringValue) {
+        ReleaseLockKey(ctx, key);
+    }
+
+    LOG_DEBUG(ctx, "Cache set successfully (expires in %lld ms)", expire);
+    RedisModule_ReplyWithSimpleString(ctx, "OK");
+    LatencyRecord(LATENCY_SET, startUs);
+    return REDISMODULE_OK;
+}
+
+// Index of the first key: 4 after a JITTER option, 2 otherwise. JITTER is
+// reserved there: a first key of that name would be read as the option, so
+// such a key has to go later in the list.
+static int MSetFirstKey(RedisModuleString **argv, int argc) {
+    return argc >= 6 && strcasecmp(RedisModule_StringPtrLen(argv[2], NULL), "JITTER") == 0 ? 4 : 2;
+}
+
+// Batched SET: cache.guard.mset <expire_ms> [JITTER pct] key value [key value ...]
+// Every argument is validated before anything is written, so a bad pair
+// rejects the whole batch. Lock keys of replaced plain strings are swept
+// once after all values are stored.
+int CacheGuardMSetCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc < 4 || (argc - 2) % 2 != 0) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    // JITTER directly after the expiry is an option, not a key, so the keys
+    // are reported through the getkeys API rather than fixed positions
+    int first = MSetFirstKey(argv, argc);
+    if (RedisModule_IsKeysPositionRequest(ctx)) {
+        for (int i = first; i < argc; i += 2) {
+            RedisModule_KeyAtPos(ctx, i);
+        }
+        return REDISMODULE_OK;
+    }
+
+    RedisModule_AutoMemory(ctx);
+
+    long long expire;
+    const char *err = ParseExpireTime(argv[1], &expire);
+    if (err) {
+        return RedisModule_ReplyWithError(ctx, err);
+    }
+
+    long long jitter = module_config.default_jitter;
+    if (first == 4 && (err = ParseJitter(argv[3], &jitter)) != NULL) {
+        return RedisModule_ReplyWithError(ctx, err);
+    }
+
+    for (int i = first; i < argc; i += 2) {
+        if ((err = ValidateKeyName(argv[i])) != NULL ||
+            (err = ValidateValue(argv[i + 1])) != NULL) {
+            return RedisModule_ReplyWithError(ctx, err);
+        }
+    }
+
+    int pairs = (argc - first) / 2;
+    int *hadStringValue = RedisModule_Calloc(pairs, sizeof(int));
+    int stringValues = 0;
+
+    for (int i = 0; i < pairs; i++) {
+        int jittered;
+        if ((err = StoreGuardedValue(ctx, argv[first + i * 2], argv[first + 1 + i * 2],
+                                     ApplyJitter(argv[first + i * 2], expire, jitter, &jittered), -1, 0, NULL,
+                                     &hadStringValue[i])) != NULL) {
+            // Only keyspace failures get here, after validation passed
+            LOG_WARNING(ctx, "Batch set stopped after %d of %d keys", i, pairs);
+            break;
+        }
+        JitterRecord(jittered);
+        stringValues += hadStringValue[i];
+    }
+
+    // Single sweep over the lock keys of replaced plain strings
+    for (int i = 0; stringValues && i < pairs; i++) {
+        if (hadStringValue[i]) {
+            ReleaseLockKey(ctx, argv[first + i * 2]);
+            stringValues--;
+        }
+    }
+    RedisModule_Free(hadStringValue);
+
+    if (err) {
+        return RedisModule_ReplyWithError(ctx, err);
+    }
+
+    LOG_DEBUG(ctx, "Cache batch set %d keys (expires in %lld ms)", pairs, expire);
+    return RedisModule_ReplyWithSimpleString(ctx, "OK");
+}
+
+// Negative caching: cache.guard.setmissing <key> <ttl_ms> [TOKEN token]
+// Stores a tombstone saying the entity does not exist, so cache.guard.get
+// replies MISSING instead of sending every lookup to the backend. Ends a
+// regeneration lease like cache.guard.set, fencing included, and wakes
+// clients waiting on the key.
+int CacheGuardSetMissingCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc != 3 && argc != 5) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    RedisModule_AutoMemory(ctx);
+
+    RedisModuleString *key = argv[1];
+    const char *err = ValidateKeyName(key);
+    if (err) {
+        return RedisModule_ReplyWithError(ctx, err);
+    }
+
+    long long ttl;
+    if ((err = ParseExpireTime(argv[2], &ttl)) != NULL) {
+        return RedisModule_ReplyWithError(ctx, err);
+    }
+
+    long long token = 0;
+    if (argc == 5) {
+        if (strcasecmp(RedisModule_StringPtrLen(argv[3], NULL), "TOKEN") != 0) {
+            return RedisModule_ReplyWithError(ctx, "ERR syntax error");
+        }
+        if (RedisModule_StringToLongLong(argv[4], &token) != REDISMODULE_OK || token < 1) {
+            return RedisModule_ReplyWithError(ctx, "ERR invalid token");
+        }
+    }
+
+    int hadStringValue;
+    if ((err = StoreGuardedValue(ctx, key, NULL, ttl, -1, (unsigned long long)token, NULL,
+                                 &hadStringValue)) != NULL) {
+        return RedisModule_ReplyWithError(ctx, err);
+    }
+    if (hadStringValue) {
+        ReleaseLockKey(ctx, key);
+    }
+
+    LOG_DEBUG(ctx, "Tombstone set (expires in %lld ms)", ttl);
+    return RedisModule_ReplyWithSimpleString(ctx, "OK");
+}
+
+// Recreates a native entry from an absolute logical expiry. Emitted by AOF
+// rewrite and propagated by set/mset in place of the original command; not
+// meant to be called by applications.
+int CacheGuardRestoreCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc < 4) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    long long expireAt;
+    if (RedisModule_StringToLongLong(argv[2], &expireAt) != REDISMODULE_OK) {
+        return RedisModule_ReplyWithError(ctx, "ERR invalid expire time format");
+    }
+
+    long long delta = 0;
+    long long token = 0;
+    int compressed = 0;
+    int missing = 0;
+    RedisModuleString *tags = NULL;
+    for (int i = 4; i < argc; i++) {
+        const char *opt = RedisModule_StringPtrLen(argv[i], NULL);
+        if (strcasecmp(opt, "DELTA") == 0 && i + 1 < argc) {
+            if (RedisModule_StringToLongLong(argv[++i], &delta) != REDISMODULE_OK || delta < 0) {
+                return RedisModule_ReplyWithError(ctx, "ERR invalid delta");
+            }
+        } else if (strcasecmp(opt, "LZ4") == 0) {
+            // The value is a compressed payload as produced by set
+            size_t len;
+            const char *ptr = RedisModule_StringPtrLen(argv[3], &len);
+            Lz4Reader reader;
+            if (Lz4ReaderInit(&reader, ptr, len) < 0) {
+                return RedisModule_ReplyWithError(ctx, "ERR invalid compressed value");
+            }
+            compressed = 1;
+        } else if (strcasecmp(opt, "MISSING") == 0) {
+            // A tombstone; the value argument is ignored
+            missing = 1;
+        } else if (strcasecmp(opt, "TOKEN") == 0 && i + 1 < argc) {
+            if (RedisModule_StringToLongLong(argv[++i], &token) != REDISMODULE_OK || token < 0) {
+                return RedisModule_ReplyWithError(ctx, "ERR invalid token");
+            }
+        } else if (strcasecmp(opt, "TAGS") == 0 && i + 1 < argc) {
+            // Tags in the stored form, as emitted by set and AOF rewrite
+            tags = argv[++i];
+            if (!ValidPackedTags(tags)) {
+                return RedisModule_ReplyWithError(ctx, "ERR invalid tags");
+            }
+        } else {
+            return RedisModule_ReplyWithError(ctx, "ERR syntax error");
+        }
+    }
+
+    RedisModuleKey *k = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    if (!k) {
+        return RedisModule_ReplyWithError(ctx, "ERR failed to access key");
+    }
+    int db = RedisModule_GetSelectedDb(ctx);
+    TagIndexRemove(db, argv[1]);
+
+    // An entry that is already past its logical expiry would only ever be
+    // served as stale; drop it like SET with a past PXAT would.
+    long long remaining = expireAt - RedisModule_Milliseconds();
+    RedisModule_ReplicateVerbatim(ctx);
+    if (remaining <= 0) {
+        RedisModule_DeleteKey(k);
+        RedisModule_CloseKey(k);
+        return RedisModule_ReplyWithSimpleString(ctx, "OK");
+    }
+
+    CacheGuardEntry *entry = CacheGuardEntryCreate();
+    if (RedisModule_ModuleTypeSetValue(k, CacheGuardType, entry) != REDISMODULE_OK) {
+        CacheGuardEntryFree(entry);
+        RedisModule_CloseKey(k);
+        return RedisModule_ReplyWithError(ctx, "ERR failed to set value");
+    }
+    if (missing) {
+        entry->flags = ENTRY_FLAG_MISSING;
+    } else {
+        RedisModule_RetainString(NULL, argv[3]);
+        entry->value = argv[3];
+        entry->flags = compressed ? ENTRY_FLAG_LZ4 : 0;
+        BloomRecordKey(argv[1]);
+        ExpiryRecord(expireAt);
+    }
+    entry->expire_at = expireAt;
+    entry->delta = delta;
+    entry->token = (unsigned long long)token;
+    ObserveLeaseToken(entry->token);
+    if (tags) {
+        RedisModule_RetainString(NULL, tags);
+        entry->tags = tags;
+        TagIndexAdd(db, argv[1], tags);
+    }
+    RedisModule_SetExpire(k, remaining);
+    RedisModule_CloseKey(k);
+    return RedisModule_ReplyWithSimpleString(ctx, "OK");
+}
+
+// Marks a key's value due for regeneration. A lease already held is revoked
+// and the token advanced, since that rebuild may have read the data that
+// changed. Tombstones have no value to keep and are deleted. Returns 1 when
+// the key was marked or deleted.
+static int MarkEntryStale(RedisModuleCtx *ctx, RedisModuleString *key) {
+    RedisModuleKey *k = RedisModule_OpenKey(ctx, key, REDISMODULE_READ | REDISMODULE_WRITE);
+    CacheGuardEntry *entry = k ? GetGuardEntry(k) : NULL;
+    if (!entry || (entry->flags & ENTRY_FLAG_PENDING)) {
+        if (k) RedisModule_CloseKey(k);
+        return 0;
+    }
+    if (entry->flags & ENTRY_FLAG_MISSING) {
+        RedisModule_DeleteKey(k);
+        RedisModule_CloseKey(k);
+        TagIndexRemove(RedisModule_GetSelectedDb(ctx), key);
+        return 1;
+    }
+
+    entry->flags |= ENTRY_FLAG_STALE;
+    entry->generation = ns_clock;
+    if (entry->lease_deadline > RedisModule_Milliseconds()) {
+        entry->lease_holder = 0;
+        entry->lease_granted_at = 0;
+        entry->lease_deadline = 0;
+        entry->token = NextLeaseToken();
+    }
+    RedisModule_CloseKey(k);
+    guard_stats.stale_marks++;
+    return 1;
+}
+
+// Soft invalidation: cache.guard.stale <key> [key ...]
+// Keeps each value but makes it due for regeneration: the next get is
+// granted the rebuild as in the grace window, and every other reader gets
+// the old value until the new one is written. Replies with the number of
+// keys marked (or tombstones deleted); missing keys and plain string values
+// are skipped.
+int CacheGuardStaleCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc < 2) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    long long marked = 0;
+    for (int i = 1; i < argc; i++) {
+        marked += MarkEntryStale(ctx, argv[i]);
+    }
+    // Lease state is local, so replicas only set the mark (or delete)
+    RedisModule_ReplicateVerbatim(ctx);
+    return RedisModule_ReplyWithLongLong(ctx, marked);
+}
+
+// Namespace invalidation: cache.guard.ns.bump <namespace> [HARD]
+// Outdates every entry of the namespace written so far, in O(1): reads
+// treat them as marked stale (cache.guard.stale), or as missing with HARD,
+// and clean each up when it is next read. Replies with the namespace's new
+// generation, the number of times it was bumped.
+int CacheGuardNsBumpCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc != 2 && argc != 3) {
+        return RedisModule_WrongArity(ctx);
+    }
+    int hard = 0;
+    if (argc == 3) {
+        if (strcasecmp(RedisModule_StringPtrLen(argv[2], NULL), "HARD") != 0) {
+            return RedisModule_ReplyWithError(ctx, "ERR syntax error");
+        }
+        hard = 1;
+    }
+
+    size_t nsLen;
+    const char *name = RedisModule_StringPtrLen(argv[1], &nsLen);
+    if (nsLen == 0 || nsLen >= MAX_KEY_LENGTH) {
+        return RedisModule_ReplyWithError(ctx, "ERR invalid namespace");
+    }
+
+    Namespace *ns = RedisModule_DictGetC(namespaces, (void *)name, nsLen, NULL);
+    if (!ns) {
+        if (RedisModule_DictSize(namespaces) >= NAMESPACE_MAX && NamespacesPrune() == 0) {
+            return RedisModule_ReplyWithError(ctx, "ERR too many namespaces (max 1000000)");
+        }
+        ns = RedisModule_Calloc(1, sizeof(*ns));
+        RedisModule_DictSetC(namespaces, (void *)name, nsLen, ns);
+    }
+    ns->soft_at = ++ns_clock;
+    if (hard) {
+        ns->hard_at = ns_clock;
+    }
+    ns->bumped_ms = RedisModule_Milliseconds();
+    ns->generation++;
+    guard_stats.ns_bumps++;
+
+    RedisModule_ReplicateVerbatim(ctx);
+    LOG_DEBUG(ctx, "Namespace bumped to generation %lld%s", ns->generation, hard ? " (hard)" : "");
+    return RedisModule_ReplyWithLongLong(ctx, ns->generation);
+}
+
+// Takes leases for claimed keys and replies with one [key, token, lease_ms]
+// triple per job that still needs a worker. Jobs completed since they were
+// handed out are skipped; jobs whose lease is held elsewhere are dropped.
+static void ReplyWithClaims(RedisModuleCtx *ctx, RedisModuleString **keys, int n, long long leaseMs) {
+    int db = RedisModule_GetSelectedDb(ctx);
+    long long replied = 0;
+    RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
+    for (int i = 0; i < n; i++) {
+        RegenJob *job = RegenJobFind(db, keys[i]);
+        if (!job || !job->claimed) {
+            continue;
+        }
+        long long lease = ClaimLeaseMs(keys[i], leaseMs);
+        unsigned long long token = ClaimJobLease(ctx, keys[i], lease);
+        if (!token) {
+            RegenJobDelete(job);
+            continue;
+        }
+        job->deadline = RedisModule_Milliseconds() + lease;
+        RedisModule_ReplyWithArray(ctx, 3);
+        RedisModule_ReplyWithString(ctx, keys[i]);
+        RedisModule_ReplyWithLongLong(ctx, (long long)token);
+        RedisModule_ReplyWithLongLong(ctx, lease);
+        guard_stats.queue_claims++;
+        replied++;
+    }
+    RedisModule_ReplySetArrayLength(ctx, replied);
+    RegenQueueScheduleTimer(ctx);
+}
+
+static int CacheGuardClaimReply(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    REDISMODULE_NOT_USED(argv);
+    REDISMODULE_NOT_USED(argc);
+    ClaimBatch *batch = RedisModule_GetBlockedClientPrivateData(ctx);
+    ReplyWithClaims(ctx, batch->keys, batch->n, batch->leaseMs);
+    return REDISMODULE_OK;
+}
+
+static int CacheGuardClaimTimeout(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    REDISMODULE_NOT_USED(argv);
+    REDISMODULE_NOT_USED(argc);
+    ClaimWaiterRemove(RedisModule_GetBlockedClientHandle(ctx));
+    return RedisModule_ReplyWithArray(ctx, 0);
+}
+
+static void CacheGuardClaimDisconnected(RedisModuleCtx *ctx, RedisModuleBlockedClient *bc) {
+    REDISMODULE_NOT_USED(ctx);
+    ClaimWaiterRemove(bc);
+}
+
+static void CacheGuardClaimFree(RedisModuleCtx *ctx, void *privdata) {
+    REDISMODULE_NOT_USED(ctx);
+    ClaimBatch *batch = privdata;
+    if (!batch) {
+        return;
+    }
+    for (int i = 0; i < batch->n; i++) {
+        RedisModule_FreeString(NULL, batch->keys[i]);
+    }
+    RedisModule_Free(batch);
+}
+
+// Worker claim: cache.guard.claim [COUNT n] [TIMEOUT ms] [LEASE ms]
+// Takes up to n (default 1) queued regeneration jobs for the selected
+// database and replies with [key, token, lease_ms] for each. The worker
+// holds each key's lease and ends it with cache.guard.set (or setmissing)
+// ... TOKEN token. Without TIMEOUT it replies at once, with an empty array
+// if nothing is queued; TIMEOUT blocks up to ms (0 = forever) for a job.
+int CacheGuardClaimCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    long long count = 1;
+    long long timeoutMs = -1;
+    long long leaseMs = 0;
+    for (int i = 1; i < argc; i++) {
+        const char *opt = RedisModule_StringPtrLen(argv[i], NULL);
+        if (strcasecmp(opt, "COUNT") == 0 && i + 1 < argc) {
+            if (RedisModule_StringToLongLong(argv[++i], &count) != REDISMODULE_OK ||
+                count < 1 || count > MAX_CLAIM_COUNT) {
+                return RedisModule_ReplyWithError(ctx, "ERR count must be between 1 and 1000");
+            }
+        } else if (strcasecmp(opt, "TIMEOUT") == 0 && i + 1 < argc) {
+            if (RedisModule_StringToLongLong(argv[++i], &timeoutMs) != REDISMODULE_OK ||
+                timeoutMs < 0 || timeoutMs > MAX_GRACE_PERIOD_MS) {
+                return RedisModule_ReplyWithError(ctx, "ERR timeout must be between 0 and 24 hours");
+            }
+        } else if (strcasecmp(opt, "LEASE") == 0 && i + 1 < argc) {
+            if (RedisModule_StringToLongLong(argv[++i], &leaseMs) != REDISMODULE_OK ||
+                !ValidLeaseDuration(leaseMs)) {
+                return RedisModule_ReplyWithError(ctx, "ERR lease must be between 100ms and max_lock_duration");
+            }
+        } else {
+            return RedisModule_ReplyWithError(ctx, "ERR syntax error");
+        }
+    }
+
+    // Take what is queued for this database now
+    int db = RedisModule_GetSelectedDb(ctx);
+    long long now = RedisModule_Milliseconds();
+    RedisModuleString *keys[MAX_CLAIM_COUNT];
+    int n = 0;
+    RegenJob *next;
+    for (RegenJob *job = regen_queue.queued.head; job && n < count; job = next) {
+        next = job->next;
+        if (job->db == db) {
+            keys[n++] = RedisModule_CreateStringFromString(NULL, job->key);
+            RegenJobClaim(job, now + ClaimLeaseMs(job->key, leaseMs));
+        }
+    }
+
+    int blockDenied = RedisModule_GetContextFlags(ctx) &
+        (REDISMODULE_CTX_FLAGS_MULTI | REDISMODULE_CTX_FLAGS_LUA | REDISMODULE_CTX_FLAGS_DENY_BLOCKING);
+    if (n > 0 || timeoutMs < 0 || blockDenied) {
+        ReplyWithClaims(ctx, keys, n, leaseMs);
+        for (int i = 0; i < n; i++) {
+            RedisModule_FreeString(NULL, keys[i]);
+        }
+        return REDISMODULE_OK;
+    }
+
+    // Nothing queued: wait for RegenQueueDispatch to hand this claim jobs
+    ClaimWaiter *w = RedisModule_Alloc(sizeof(*w));
+    w->bc = RedisModule_BlockClient(ctx, CacheGuardClaimReply, CacheGuardClaimTimeout,
+                                    CacheGuardClaimFree, timeoutMs);
+    w->db = db;
+    w->count = count;
+    w->leaseMs = leaseMs;
+    w->next = NULL;
+    RedisModule_SetDisconnectCallback(w->bc, CacheGuardClaimDisconnected);
+    ClaimWaiter **wp = &regen_queue.waiters;
+    while (*wp) {
+        wp = &(*wp)->next;
+    }
+    *wp = w;
+    return REDISMODULE_OK;
+}
+
+// Keys one invalidation step processes before yielding to other clients
+#define INVALIDATE_BATCH 1000
+
+static RedisModuleTimerID invalidate_timer = 0;
+
+// Drops a key of an invalidated tag, or with soft marks it stale as
+// cache.guard.stale does. Soft-invalidated keys keep their tags and are
+// filed again under the tags' new key sets.
+static int InvalidateTaggedKey(RedisModuleCtx *ctx, RedisModuleString *key, int soft) {
+    RedisModuleKey *k = RedisModule_OpenKey(ctx, key, REDISMODULE_READ | REDISMODULE_WRITE);
+    CacheGuardEntry *entry = k ? GetGuardEntry(k) : NULL;
+    if (!entry || !entry->tags) {
+        if (k) RedisModule_CloseKey(k);
+        return 0;
+    }
+
+    int db = RedisModule_GetSelectedDb(ctx);
+    if (soft) {
+        // Refile first: a tombstone is deleted, and unfiled, by the mark
+        TagIndexAdd(db, key, entry->tags);
+        RedisModule_CloseKey(k);
+        MarkEntryStale(ctx, key);
+        RedisModule_Replicate(ctx, "cache.guard.stale", "s", key);
+        return 1;
+    }
+
+    RedisModule_DeleteKey(k);
+    RedisModule_CloseKey(k);
+    TagIndexRemove(db, key);
+    RedisModule_Replicate(ctx, "DEL", "s", key);
+    return 1;
+}
+
+// Works through up to INVALIDATE_BATCH keys of the oldest invalidation and
+// frees it once its set is empty. Returns whether work is left.
+static int InvalidateStep(RedisModuleCtx *ctx) {
+    TagInvalidation *inv = tag_invalidations;
+    if (!inv) {
+        return 0;
+    }
+    int db = RedisModule_GetSelectedDb(ctx);
+    RedisModule_SelectDb(ctx, inv->db);
+
+    char name[MAX_KEY_LENGTH];
+    for (int n = 0; n < INVALIDATE_BATCH; n++) {
+        RedisModuleDictIter *it = RedisModule_DictIteratorStartC(inv->keys, "^", NULL, 0);
+        size_t len;
+        char *ptr = RedisModule_DictNextC(it, &len, NULL);
+        if (ptr) {
+            memcpy(name, ptr, len);
+        }
+        RedisModule_DictIteratorStop(it);
+        if (!ptr) {
+            break;
+        }
+        RedisModule_DictDelC(inv->keys, name, len, NULL);
+        RedisModuleString *key = RedisModule_CreateString(NULL, name, len);
+        guard_stats.invalidated_keys += InvalidateTaggedKey(ctx, key, inv->soft);
+        RedisModule_FreeString(NULL, key);
+    }
+
+    RedisModule_SelectDb(ctx, db);
+    if (RedisModule_DictSize(inv->keys) == 0) {
+        tag_invalidations = inv->next;
+        RedisModule_FreeDict(NULL, inv->keys);
+        RedisModule_Free(inv);
+    }
+    return tag_invalidations != NULL;
+}
+
+// Keys of issued invalidations not processed yet
+static long long InvalidationsPending(void) {
+    long long pending = 0;
+    for (TagInvalidation *inv = tag_invalidations; inv; inv = inv->next) {
+        pending += (long long)RedisModule_DictSize(inv->keys);
+    }
+    return pending;
+}
+
+static void InvalidateTimer(RedisModuleCtx *ctx, void *data) {
+    REDISMODULE_NOT_USED(data);
+    invalidate_timer = 0;
+    if (InvalidateStep(ctx)) {
+        invalidate_timer = RedisModule_CreateTimer(ctx, 1, InvalidateTimer, NULL);
+    }
+}
+
+// Tag invalidation: cache.guard.invalidate TAG <tag> [SOFT]
+// Deletes every key filed under tag in the selected database, or with SOFT
+// moves each into its grace window so readers get the old value while one
+// of them regenerates. Replies with the number of keys filed under the tag.
+// The first INVALIDATE_BATCH keys are handled before the reply, the rest in
+// later event loop iterations; writes made after the call are not affected.
+int CacheGuardInvalidateCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc != 3 && argc != 4) {
+        return RedisModule_WrongArity(ctx);
+    }
+    if (strcasecmp(RedisModule_StringPtrLen(argv[1], NULL), "TAG") != 0) {
+        return RedisModule_ReplyWithError(ctx, "ERR syntax error");
+    }
+    int soft = 0;
+    if (argc == 4) {
+        if (strcasecmp(RedisModule_StringPtrLen(argv[3], NULL), "SOFT") != 0) {
+            return RedisModule_ReplyWithError(ctx, "ERR syntax error");
+        }
+        soft = 1;
+    }
+
+    size_t tagLen;
+    const char *tag = RedisModule_StringPtrLen(argv[2], &tagLen);
+    if (tagLen == 0 || tagLen > MAX_KEY_LENGTH || memchr(tag, '\0', tagLen)) {
+        return RedisModule_ReplyWithError(ctx, "ERR invalid tag");
+    }
+
+    // Detach the tag's key set, so keys tagged from now on form a new one
+    int db = RedisModule_GetSelectedDb(ctx);
+    char name[DB_SCOPED_NAME_MAX];
+    RedisModuleDict *keys = NULL;
+    if (RedisModule_DictDelC(tag_index, name, DbScopedName(db, tag, tagLen, name), &keys) != REDISMODULE_OK) {
+        return RedisModule_ReplyWithLongLong(ctx, 0);
+    }
+    long long count = (long long)RedisModule_DictSize(keys);
+
+    TagInvalidation *inv = RedisModule_Alloc(sizeof(*inv));
+    inv->keys = keys;
+    inv->db = db;
+    inv->soft = soft;
+    inv->next = NULL;
+    TagInvalidation **ip = &tag_invalidations;
+    while (*ip) {
+        ip = &(*ip)->next;
+    }
+    *ip = inv;
+
+    // Small tags finish here; larger ones continue from the timer
+    if (inv == tag_invalidations && InvalidateStep(ctx) && !invalidate_timer) {
+        invalidate_timer = RedisModule_CreateTimer(ctx, 1, InvalidateTimer, NULL);
+    }
+    LOG_DEBUG(ctx, "Tag invalidation of %lld keys (%s)", count, soft ? "soft" : "drop");
+    return RedisModule_ReplyWithLongLong(ctx, count);
+}
+
+// Module info command for observability
+int CacheGuardInfoCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    REDISMODULE_NOT_USED(argv);
+    REDISMODULE_NOT_USED(argc);
+    
+    RedisModule_ReplyWithArray(ctx, 22 + GUARD_STAT_FIELDS * 2);
+    
     RedisModule_ReplyWithSimpleString(ctx, "module");
     RedisModule_ReplyWithSimpleString(ctx, "cacheguard");
     
@@ -298,10 +3665,337 @@ int CacheGuardInfoCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int arg
     
     RedisModule_ReplyWithSimpleString(ctx, "max_lock_duration_ms");
     RedisModule_ReplyWithLongLong(ctx, module_config.max_lock_duration);
+
+    for (size_t i = 0; i < GUARD_STAT_FIELDS; i++) {
+        RedisModule_ReplyWithSimpleString(ctx, GuardStatFields[i].name);
+        RedisModule_ReplyWithLongLong(ctx, (long long)*GuardStatFields[i].counter);
+    }
+
+    // Per second for the next minute, per minute for the next hour
+    unsigned long long schedule[60];
+    RedisModule_ReplyWithSimpleString(ctx, "expiry_next_minute");
+    RedisModule_ReplyWithArray(ctx, 60);
+    ExpirySchedule(1, 60, schedule);
+    for (int i = 0; i < 60; i++) {
+        RedisModule_ReplyWithLongLong(ctx, (long long)schedule[i]);
+    }
+    RedisModule_ReplyWithSimpleString(ctx, "expiry_next_hour");
+    RedisModule_ReplyWithArray(ctx, 60);
+    ExpirySchedule(60, 60, schedule);
+    for (int i = 0; i < 60; i++) {
+        RedisModule_ReplyWithLongLong(ctx, (long long)schedule[i]);
+    }
+
+    RedisModule_ReplyWithSimpleString(ctx, "queue_length");
+    RedisModule_ReplyWithLongLong(ctx, (long long)regen_queue.queued.len);
+    RedisModule_ReplyWithSimpleString(ctx, "queue_claimed");
+    RedisModule_ReplyWithLongLong(ctx, (long long)regen_queue.claimed.len);
+
+    RedisModule_ReplyWithSimpleString(ctx, "tagged_keys");
+    RedisModule_ReplyWithLongLong(ctx, (long long)RedisModule_DictSize(tagged_keys));
+    RedisModule_ReplyWithSimpleString(ctx, "invalidations_pending");
+    RedisModule_ReplyWithLongLong(ctx, InvalidationsPending());
+    RedisModule_ReplyWithSimpleString(ctx, "namespaces");
+    RedisModule_ReplyWithLongLong(ctx, (long long)RedisModule_DictSize(namespaces));
     
     return REDISMODULE_OK;
 }
 
+// INFO section: exposes the counters as "# cacheguard" for INFO scrapers
+static void CacheGuardInfoFunc(RedisModuleInfoCtx *ctx, int for_crash_report) {
+    REDISMODULE_NOT_USED(for_crash_report);
+
+    RedisModule_InfoAddSection(ctx, "");
+    for (size_t i = 0; i < GUARD_STAT_FIELDS; i++) {
+        RedisModule_InfoAddFieldULongLong(ctx, GuardStatFields[i].name,
+                                          *GuardStatFields[i].counter);
+    }
+
+    unsigned long long schedule[60];
+    char list[60 * 21];
+    for (int hour = 0; hour < 2; hour++) {
+        ExpirySchedule(hour ? 60 : 1, 60, schedule);
+        size_t len = 0;
+        for (int i = 0; i < 60; i++) {
+            len += snprintf(list + len, sizeof(list) - len, "%s%llu", i ? "," : "", schedule[i]);
+        }
+        RedisModule_InfoAddFieldCString(ctx, hour ? "expiry_next_hour" : "expiry_next_minute", list);
+    }
+    RedisModule_InfoAddFieldULongLong(ctx, "queue_length", regen_queue.queued.len);
+    RedisModule_InfoAddFieldULongLong(ctx, "queue_claimed", regen_queue.claimed.len);
+    RedisModule_InfoAddFieldULongLong(ctx, "tagged_keys", RedisModule_DictSize(tagged_keys));
+    RedisModule_InfoAddFieldLongLong(ctx, "invalidations_pending", InvalidationsPending());
+    RedisModule_InfoAddFieldULongLong(ctx, "namespaces", RedisModule_DictSize(namespaces));
+}
+
+// Latency command: cache.guard.latency
+// Replies with one entry per histogram (get outcomes and set), each holding
+// the sample count and percentiles in microseconds.
+int CacheGuardLatencyCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc == 2 && strcasecmp(RedisModule_StringPtrLen(argv[1], NULL), "RESET") == 0) {
+        return RedisModule_ReplyWithError(ctx, "ERR use cache.guard.latency.reset");
+    }
+    if (argc != 1) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    static const struct { const char *name; double pct; } percentiles[] = {
+        { "p50", 50.0 }, { "p90", 90.0 }, { "p99", 99.0 }, { "p99.9", 99.9 }
+    };
+    size_t npct = sizeof(percentiles) / sizeof(percentiles[0]);
+    size_t nhist = sizeof(latency_hist) / sizeof(latency_hist[0]);
+
+    RedisModule_ReplyWithArray(ctx, nhist * 2);
+    for (size_t i = 0; i < nhist; i++) {
+        const LatencyHistogram *h = &latency_hist[i];
+        RedisModule_ReplyWithSimpleString(ctx, LatencyHistogramName(i));
+        RedisModule_ReplyWithArray(ctx, (npct + 2) * 2);
+        RedisModule_ReplyWithSimpleString(ctx, "count");
+        RedisModule_ReplyWithLongLong(ctx, (long long)h->count);
+        for (size_t p = 0; p < npct; p++) {
+            RedisModule_ReplyWithSimpleString(ctx, percentiles[p].name);
+            RedisModule_ReplyWithLongLong(ctx, LatencyPercentile(h, percentiles[p].pct));
+        }
+        RedisModule_ReplyWithSimpleString(ctx, "max");
+        RedisModule_ReplyWithLongLong(ctx, h->max_us);
+    }
+    return REDISMODULE_OK;
+}
+
+// Clears every latency histogram: cache.guard.latency.reset
+int CacheGuardLatencyResetCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    REDISMODULE_NOT_USED(argv);
+    if (argc != 1) {
+        return RedisModule_WrongArity(ctx);
+    }
+    memset(latency_hist, 0, sizeof(latency_hist));
+    return RedisModule_ReplyWithSimpleString(ctx, "OK");
+}
+
+// Grace command: cache.guard.grace [prefix]
+// Lists what adaptive grace has learned, one entry per key prefix: samples
+// seen, EWMA and p95 regeneration time, and the grace AUTO calls get.
+// With a prefix, replies with that entry alone (null if it has none).
+static void ReplyWithGracePrefix(RedisModuleCtx *ctx, const GracePrefix *gp) {
+    RedisModule_ReplyWithArray(ctx, 8);
+    RedisModule_ReplyWithSimpleString(ctx, "samples");
+    RedisModule_ReplyWithLongLong(ctx, (long long)gp->count);
+    RedisModule_ReplyWithSimpleString(ctx, "ewma_ms");
+    RedisModule_ReplyWithLongLong(ctx, llround(gp->ewma_ms));
+    RedisModule_ReplyWithSimpleString(ctx, "p95_ms");
+    RedisModule_ReplyWithLongLong(ctx, gp->p95_ms);
+    RedisModule_ReplyWithSimpleString(ctx, "grace_ms");
+    RedisModule_ReplyWithLongLong(ctx, gp->grace_ms);
+}
+
+int CacheGuardGraceCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc > 2) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    if (argc == 2) {
+        size_t len;
+        const char *prefix = RedisModule_StringPtrLen(argv[1], &len);
+        GracePrefix *gp = RedisModule_DictGetC(grace_prefixes, (void *)prefix, len, NULL);
+        if (!gp) {
+            return RedisModule_ReplyWithNull(ctx);
+        }
+        ReplyWithGracePrefix(ctx, gp);
+        return REDISMODULE_OK;
+    }
+
+    RedisModule_ReplyWithArray(ctx, RedisModule_DictSize(grace_prefixes) * 2);
+    RedisModuleDictIter *it = RedisModule_DictIteratorStartC(grace_prefixes, "^", NULL, 0);
+    const char *prefix;
+    size_t len;
+    GracePrefix *gp;
+    while ((prefix = RedisModule_DictNextC(it, &len, (void **)&gp)) != NULL) {
+        RedisModule_ReplyWithStringBuffer(ctx, prefix, len);
+        ReplyWithGracePrefix(ctx, gp);
+    }
+    RedisModule_DictIteratorStop(it);
+    return REDISMODULE_OK;
+}
+
+// Hot keys command: cache.guard.hotkeys [N]
+// Replies with up to N (default 10) of the hottest keys, hottest first, each
+// followed by its decayed access estimate and the stale serves and
+// regeneration grants seen since it entered the list.
+int CacheGuardHotKeysCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc > 2) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    long long limit = 10;
+    if (argc == 2) {
+        if (strcasecmp(RedisModule_StringPtrLen(argv[1], NULL), "RESET") == 0) {
+            return RedisModule_ReplyWithError(ctx, "ERR use cache.guard.hotkeys.reset");
+        }
+        if (RedisModule_StringToLongLong(argv[1], &limit) != REDISMODULE_OK ||
+            limit < 1 || limit > HOTKEYS_TOPK) {
+            return RedisModule_ReplyWithError(ctx, "ERR count must be between 1 and 32");
+        }
+    }
+
+    HotKeysDecay(RedisModule_Milliseconds());
+
+    const HotKey *order[HOTKEYS_TOPK];
+    int n = 0;
+    for (int i = 0; i < HOTKEYS_TOPK; i++) {
+        if (hotkeys.top[i].key) order[n++] = &hotkeys.top[i];
+    }
+    qsort(order, n, sizeof(order[0]), CompareHotKeys);
+    if (n > limit) {
+        n = (int)limit;
+    }
+
+    RedisModule_ReplyWithArray(ctx, n * 2);
+    for (int i = 0; i < n; i++) {
+        const HotKey *hk = order[i];
+        RedisModule_ReplyWithStringBuffer(ctx, hk->key, hk->len);
+        RedisModule_ReplyWithArray(ctx, 6);
+        RedisModule_ReplyWithSimpleString(ctx, "count");
+        RedisModule_ReplyWithLongLong(ctx, hk->count);
+        RedisModule_ReplyWithSimpleString(ctx, "stale_serves");
+        RedisModule_ReplyWithLongLong(ctx, hk->stale_serves);
+        RedisModule_ReplyWithSimpleString(ctx, "regen_grants");
+        RedisModule_ReplyWithLongLong(ctx, hk->regen_grants);
+    }
+    return REDISMODULE_OK;
+}
+
+// Clears the sketch and the tracked keys: cache.guard.hotkeys.reset
+int CacheGuardHotKeysResetCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    REDISMODULE_NOT_USED(argv);
+    if (argc != 1) {
+        return RedisModule_WrongArity(ctx);
+    }
+    HotKeysReset();
+    return RedisModule_ReplyWithSimpleString(ctx, "OK");
+}
+
+// Bloom command:
+//   cache.guard.bloom RESERVE <namespace> <capacity> <error_rate>
+//   cache.guard.bloom ADD <key> [key ...]
+//   cache.guard.bloom ENABLE <namespace>
+//   cache.guard.bloom DROP <namespace>
+//   cache.guard.bloom INFO [namespace]
+// RESERVE creates (or empties) a namespace's filter, which get ignores until
+// ENABLE. ADD replies with how many keys belonged to a namespace with a filter.
+static void ReplyWithBloomFilter(RedisModuleCtx *ctx, const BloomFilter *bf) {
+    long long items = 0;
+    for (int i = 0; i < bf->nlayers; i++) {
+        items += bf->layers[i].items;
+    }
+    RedisModule_ReplyWithArray(ctx, 14);
+    RedisModule_ReplyWithSimpleString(ctx, "capacity");
+    RedisModule_ReplyWithLongLong(ctx, bf->capacity);
+    RedisModule_ReplyWithSimpleString(ctx, "error_rate");
+    RedisModule_ReplyWithDouble(ctx, bf->error_rate);
+    RedisModule_ReplyWithSimpleString(ctx, "items");
+    RedisModule_ReplyWithLongLong(ctx, items);
+    RedisModule_ReplyWithSimpleString(ctx, "layers");
+    RedisModule_ReplyWithLongLong(ctx, bf->nlayers);
+    RedisModule_ReplyWithSimpleString(ctx, "bytes");
+    RedisModule_ReplyWithLongLong(ctx, (long long)BloomFilterBytes(bf));
+    RedisModule_ReplyWithSimpleString(ctx, "enabled");
+    RedisModule_ReplyWithLongLong(ctx, bf->enabled);
+    RedisModule_ReplyWithSimpleString(ctx, "saturated");
+    RedisModule_ReplyWithLongLong(ctx, bf->saturated);
+}
+
+int CacheGuardBloomCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc < 2) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    const char *sub = RedisModule_StringPtrLen(argv[1], NULL);
+    size_t nsLen = 0;
+    const char *ns = argc > 2 ? RedisModule_StringPtrLen(argv[2], &nsLen) : NULL;
+
+    if (strcasecmp(sub, "RESERVE") == 0) {
+        if (argc != 5) {
+            return RedisModule_WrongArity(ctx);
+        }
+        if (nsLen == 0 || nsLen >= MAX_KEY_LENGTH) {
+            return RedisModule_ReplyWithError(ctx, "ERR invalid namespace");
+        }
+        long long capacity;
+        double errorRate;
+        if (RedisModule_StringToLongLong(argv[3], &capacity) != REDISMODULE_OK ||
+            capacity < 1 || capacity > BLOOM_MAX_CAPACITY) {
+            return RedisModule_ReplyWithError(ctx, "ERR capacity must be between 1 and 100000000");
+        }
+        if (RedisModule_StringToDouble(argv[4], &errorRate) != REDISMODULE_OK ||
+            errorRate < BLOOM_MIN_ERROR || errorRate > BLOOM_MAX_ERROR) {
+            return RedisModule_ReplyWithError(ctx, "ERR error rate must be between 0.00001 and 0.25");
+        }
+        BloomFilter *old = RedisModule_DictGetC(bloom_filters, (void *)ns, nsLen, NULL);
+        if (!old && RedisModule_DictSize(bloom_filters) >= BLOOM_MAX_FILTERS) {
+            return RedisModule_ReplyWithError(ctx, "ERR too many Bloom filters (max 64)");
+        }
+        if (old) {
+            BloomFilterFree(old);
+        }
+        RedisModule_DictReplaceC(bloom_filters, (void *)ns, nsLen, BloomFilterCreate(capacity, errorRate));
+        return RedisModule_ReplyWithSimpleString(ctx, "OK");
+    } else if (strcasecmp(sub, "ADD") == 0) {
+        if (argc < 3) {
+            return RedisModule_WrongArity(ctx);
+        }
+        const char *err;
+        for (int i = 2; i < argc; i++) {
+            if ((err = ValidateKeyName(argv[i])) != NULL) {
+                return RedisModule_ReplyWithError(ctx, err);
+            }
+        }
+        long long added = 0;
+        for (int i = 2; i < argc; i++) {
+            added += BloomRecordKey(argv[i]);
+        }
+        return RedisModule_ReplyWithLongLong(ctx, added);
+    } else if (strcasecmp(sub, "ENABLE") == 0 || strcasecmp(sub, "DROP") == 0) {
+        if (argc != 3) {
+            return RedisModule_WrongArity(ctx);
+        }
+        BloomFilter *bf = RedisModule_DictGetC(bloom_filters, (void *)ns, nsLen, NULL);
+        if (!bf) {
+            return RedisModule_ReplyWithError(ctx, "ERR no Bloom filter for this namespace");
+        }
+        if (strcasecmp(sub, "ENABLE") == 0) {
+            bf->enabled = 1;
+        } else {
+            RedisModule_DictDelC(bloom_filters, (void *)ns, nsLen, NULL);
+            BloomFilterFree(bf);
+        }
+        return RedisModule_ReplyWithSimpleString(ctx, "OK");
+    } else if (strcasecmp(sub, "INFO") == 0) {
+        if (argc > 3) {
+            return RedisModule_WrongArity(ctx);
+        }
+        if (ns) {
+            BloomFilter *bf = RedisModule_DictGetC(bloom_filters, (void *)ns, nsLen, NULL);
+            if (!bf) {
+                return RedisModule_ReplyWithNull(ctx);
+            }
+            ReplyWithBloomFilter(ctx, bf);
+            return REDISMODULE_OK;
+        }
+        RedisModule_ReplyWithArray(ctx, RedisModule_DictSize(bloom_filters) * 2);
+        RedisModuleDictIter *it = RedisModule_DictIteratorStartC(bloom_filters, "^", NULL, 0);
+        const char *name;
+        size_t len;
+        BloomFilter *bf;
+        while ((name = RedisModule_DictNextC(it, &len, (void **)&bf)) != NULL) {
+            RedisModule_ReplyWithStringBuffer(ctx, name, len);
+            ReplyWithBloomFilter(ctx, bf);
+        }
+        RedisModule_DictIteratorStop(it);
+        return REDISMODULE_OK;
+    }
+    return RedisModule_ReplyWithError(ctx, "ERR unknown subcommand");
+}
+
 // Configuration command
 int CacheGuardConfigCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
     if (argc < 2) {
@@ -321,6 +4015,37 @@ int CacheGuardConfigCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int a
             return RedisModule_ReplyWithLongLong(ctx, module_config.log_level);
         } else if (strcasecmp(param, "max_lock_duration") == 0) {
             return RedisModule_ReplyWithLongLong(ctx, module_config.max_lock_duration);
+        } else if (strcasecmp(param, "xfetch") == 0) {
+            return RedisModule_ReplyWithLongLong(ctx, module_config.xfetch);
+        } else if (strcasecmp(param, "xfetch_beta") == 0) {
+            return RedisModule_ReplyWithDouble(ctx, module_config.xfetch_beta);
+        } else if (strcasecmp(param, "lock_on_miss") == 0) {
+            return RedisModule_ReplyWithLongLong(ctx, module_config.lock_on_miss);
+        } else if (strcasecmp(param, "default_lease") == 0) {
+            return RedisModule_ReplyWithLongLong(ctx, module_config.default_lease);
+        } else if (strcasecmp(param, "default_grace_period") == 0) {
+            return RedisModule_ReplyWithLongLong(ctx, module_config.default_grace_period);
+        } else if (strcasecmp(param, "grace_margin") == 0) {
+            return RedisModule_ReplyWithLongLong(ctx, module_config.grace_margin);
+        } else if (strcasecmp(param, "grace_prefix_depth") == 0) {
+            return RedisModule_ReplyWithLongLong(ctx, module_config.grace_prefix_depth);
+        } else if (strcasecmp(param, "compress_threshold") == 0) {
+            return RedisModule_ReplyWithLongLong(ctx, module_config.compress_threshold);
+        } else if (strcasecmp(param, "default_jitter") == 0) {
+            return RedisModule_ReplyWithLongLong(ctx, module_config.default_jitter);
+        } else if (strcasecmp(param, "hotkeys") == 0) {
+            return RedisModule_ReplyWithLongLong(ctx, module_config.hotkeys);
+        } else if (strcasecmp(param, "hotkeys_halflife") == 0) {
+            return RedisModule_ReplyWithLongLong(ctx, module_config.hotkeys_halflife);
+        } else if (strcasecmp(param, "refresh_ahead") == 0) {
+            return RedisModule_ReplyWithLongLong(ctx, module_config.refresh_ahead);
+        } else if (strcasecmp(param, "refresh_stream") == 0) {
+            return RedisModule_ReplyWithStringBuffer(ctx, module_config.refresh_stream,
+                                                     strlen(module_config.refresh_stream));
+        } else if (strcasecmp(param, "refresh_stream_maxlen") == 0) {
+            return RedisModule_ReplyWithLongLong(ctx, module_config.refresh_stream_maxlen);
+        } else if (strcasecmp(param, "regen_queue") == 0) {
+            return RedisModule_ReplyWithLongLong(ctx, module_config.regen_queue);
         } else {
             return RedisModule_ReplyWithError(ctx, "ERR unknown parameter");
         }
@@ -329,6 +4054,27 @@ int CacheGuardConfigCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int a
         
         size_t paramLen;
         const char *param = RedisModule_StringPtrLen(argv[2], &paramLen);
+
+        if (strcasecmp(param, "xfetch_beta") == 0) {
+            double beta;
+            if (RedisModule_StringToDouble(argv[3], &beta) != REDISMODULE_OK) {
+                return RedisModule_ReplyWithError(ctx, "ERR invalid value");
+            }
+            if (!(beta > 0 && beta <= 10)) {
+                return RedisModule_ReplyWithError(ctx, "ERR xfetch beta must be greater than 0 and at most 10");
+            }
+            module_config.xfetch_beta = beta;
+            return RedisModule_ReplyWithSimpleString(ctx, "OK");
+        } else if (strcasecmp(param, "refresh_stream") == 0) {
+            size_t len;
+            const char *name = RedisModule_StringPtrLen(argv[3], &len);
+            if (len == 0 || len > MAX_KEY_LENGTH || memchr(name, '\0', len)) {
+                return RedisModule_ReplyWithError(ctx, "ERR invalid stream name");
+            }
+            memcpy(module_config.refresh_stream, name, len);
+            module_config.refresh_stream[len] = '\0';
+            return RedisModule_ReplyWithSimpleString(ctx, "OK");
+        }
         
         long long value;
         if (RedisModule_StringToLongLong(argv[3], &value) != REDISMODULE_OK) {
@@ -347,6 +4093,94 @@ int CacheGuardConfigCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int a
             }
             module_config.max_lock_duration = value;
             return RedisModule_ReplyWithSimpleString(ctx, "OK");
+        } else if (strcasecmp(param, "xfetch") == 0) {
+            if (value != 0 && value != 1) {
+                return RedisModule_ReplyWithError(ctx, "ERR xfetch must be 0 or 1");
+            }
+            module_config.xfetch = value;
+            return RedisModule_ReplyWithSimpleString(ctx, "OK");
+        } else if (strcasecmp(param, "lock_on_miss") == 0) {
+            if (value != 0 && value != 1) {
+                return RedisModule_ReplyWithError(ctx, "ERR lock_on_miss must be 0 or 1");
+            }
+            module_config.lock_on_miss = value;
+            return RedisModule_ReplyWithSimpleString(ctx, "OK");
+        } else if (strcasecmp(param, "default_lease") == 0) {
+            if (value != 0 && (value < MIN_GRACE_PERIOD_MS || value > module_config.max_lock_duration)) {
+                return RedisModule_ReplyWithError(ctx, "ERR default lease must be 0 or between 100ms and max_lock_duration");
+            }
+            module_config.default_lease = value;
+            return RedisModule_ReplyWithSimpleString(ctx, "OK");
+        } else if (strcasecmp(param, "default_grace_period") == 0) {
+            if (value < MIN_GRACE_PERIOD_MS || value > MAX_GRACE_PERIOD_MS) {
+                return RedisModule_ReplyWithError(ctx, "ERR grace period must be between 100ms and 24 hours");
+            }
+            module_config.default_grace_period = value;
+            return RedisModule_ReplyWithSimpleString(ctx, "OK");
+        } else if (strcasecmp(param, "grace_margin") == 0) {
+            if (value < 0 || value > 1000) {
+                return RedisModule_ReplyWithError(ctx, "ERR grace margin must be 0-1000 percent");
+            }
+            module_config.grace_margin = value;
+            GracePrefixesRefresh();
+            return RedisModule_ReplyWithSimpleString(ctx, "OK");
+        } else if (strcasecmp(param, "grace_prefix_depth") == 0) {
+            if (value < 1 || value > 8) {
+                return RedisModule_ReplyWithError(ctx, "ERR grace prefix depth must be 1-8");
+            }
+            if (value != module_config.grace_prefix_depth) {
+                module_config.grace_prefix_depth = value;
+                GracePrefixesReset();
+            }
+            return RedisModule_ReplyWithSimpleString(ctx, "OK");
+        } else if (strcasecmp(param, "compress_threshold") == 0) {
+            if (value != 0 && (value < 64 || value > MAX_VALUE_SIZE)) {
+                return RedisModule_ReplyWithError(ctx, "ERR compress threshold must be 0 or between 64 bytes and 10MB");
+            }
+            module_config.compress_threshold = value;
+            return RedisModule_ReplyWithSimpleString(ctx, "OK");
+        } else if (strcasecmp(param, "default_jitter") == 0) {
+            if (value < 0 || value > MAX_JITTER_PCT) {
+                return RedisModule_ReplyWithError(ctx, "ERR jitter must be between 0 and 50 percent");
+            }
+            module_config.default_jitter = value;
+            return RedisModule_ReplyWithSimpleString(ctx, "OK");
+        } else if (strcasecmp(param, "hotkeys") == 0) {
+            if (value != 0 && value != 1) {
+                return RedisModule_ReplyWithError(ctx, "ERR hotkeys must be 0 or 1");
+            }
+            module_config.hotkeys = value;
+            return RedisModule_ReplyWithSimpleString(ctx, "OK");
+        } else if (strcasecmp(param, "hotkeys_halflife") == 0) {
+            if (value != 0 && (value < 1000 || value > MAX_GRACE_PERIOD_MS)) {
+                return RedisModule_ReplyWithError(ctx, "ERR hotkeys half-life must be 0 or between 1s and 24 hours");
+            }
+            // Apply the old half-life up to now so the new one starts clean
+            HotKeysDecay(RedisModule_Milliseconds());
+            module_config.hotkeys_halflife = value;
+            hotkeys.last_decay = RedisModule_Milliseconds();
+            return RedisModule_ReplyWithSimpleString(ctx, "OK");
+        } else if (strcasecmp(param, "refresh_ahead") == 0) {
+            if (value != 0 && value != 1) {
+                return RedisModule_ReplyWithError(ctx, "ERR refresh_ahead must be 0 or 1");
+            }
+            if (value && !RefreshAheadAllowed(ctx)) {
+                return RedisModule_ReplyWithError(ctx, "ERR refresh_ahead is not supported in Redis Cluster, use regen_queue");
+            }
+            module_config.refresh_ahead = value;
+            return RedisModule_ReplyWithSimpleString(ctx, "OK");
+        } else if (strcasecmp(param, "refresh_stream_maxlen") == 0) {
+            if (value < 0) {
+                return RedisModule_ReplyWithError(ctx, "ERR refresh stream maxlen must be 0 or positive");
+            }
+            module_config.refresh_stream_maxlen = value;
+            return RedisModule_ReplyWithSimpleString(ctx, "OK");
+        } else if (strcasecmp(param, "regen_queue") == 0) {
+            if (value != 0 && value != 1) {
+                return RedisModule_ReplyWithError(ctx, "ERR regen_queue must be 0 or 1");
+            }
+            module_config.regen_queue = value;
+            return RedisModule_ReplyWithSimpleString(ctx, "OK");
         } else {
             return RedisModule_ReplyWithError(ctx, "ERR unknown parameter");
         }
@@ -355,6 +4189,153 @@ int CacheGuardConfigCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int a
     }
 }
 
+// Key specs (Redis 7+). The only key each command names is the value key:
+// leases live in the entry, and legacy lock keys hash to the same slot.
+static RedisModuleCommandKeySpec GetKeySpecs[] = {
+    {
+        .notes = "May create a lease placeholder on a miss (lock-on-miss)",
+        .flags = REDISMODULE_CMD_KEY_RW | REDISMODULE_CMD_KEY_ACCESS |
+                 REDISMODULE_CMD_KEY_UPDATE | REDISMODULE_CMD_KEY_INSERT,
+        .begin_search_type = REDISMODULE_KSPEC_BS_INDEX,
+        .bs.index.pos = 1,
+        .find_keys_type = REDISMODULE_KSPEC_FK_RANGE,
+        .fk.range = { 0, 1, 0 }
+    },
+    { 0 }
+};
+
+static RedisModuleCommandKeySpec MGetKeySpecs[] = {
+    {
+        .flags = REDISMODULE_CMD_KEY_RW | REDISMODULE_CMD_KEY_ACCESS |
+                 REDISMODULE_CMD_KEY_UPDATE | REDISMODULE_CMD_KEY_INSERT,
+        .begin_search_type = REDISMODULE_KSPEC_BS_INDEX,
+        .bs.index.pos = 2,
+        .find_keys_type = REDISMODULE_KSPEC_FK_RANGE,
+        .fk.range = { -1, 1, 0 }
+    },
+    { 0 }
+};
+
+static RedisModuleCommandKeySpec GetRangeKeySpecs[] = {
+    {
+        .flags = REDISMODULE_CMD_KEY_RO | REDISMODULE_CMD_KEY_ACCESS,
+        .begin_search_type = REDISMODULE_KSPEC_BS_INDEX,
+        .bs.index.pos = 1,
+        .find_keys_type = REDISMODULE_KSPEC_FK_RANGE,
+        .fk.range = { 0, 1, 0 }
+    },
+    { 0 }
+};
+
+static RedisModuleCommandKeySpec SetKeySpecs[] = {
+    {
+        .notes = "Reads the existing entry for its lease and fencing token",
+        .flags = REDISMODULE_CMD_KEY_RW | REDISMODULE_CMD_KEY_UPDATE,
+        .begin_search_type = REDISMODULE_KSPEC_BS_INDEX,
+        .bs.index.pos = 1,
+        .find_keys_type = REDISMODULE_KSPEC_FK_RANGE,
+        .fk.range = { 0, 1, 0 }
+    },
+    { 0 }
+};
+
+static RedisModuleCommandKeySpec MSetKeySpecs[] = {
+    {
+        .notes = "Keys start two arguments later after JITTER; the getkeys API reports them exactly",
+        .flags = REDISMODULE_CMD_KEY_RW | REDISMODULE_CMD_KEY_UPDATE | REDISMODULE_CMD_KEY_INCOMPLETE,
+        .begin_search_type = REDISMODULE_KSPEC_BS_INDEX,
+        .bs.index.pos = 2,
+        .find_keys_type = REDISMODULE_KSPEC_FK_RANGE,
+        .fk.range = { -1, 2, 0 }
+    },
+    { 0 }
+};
+
+static RedisModuleCommandKeySpec RestoreKeySpecs[] = {
+    {
+        .flags = REDISMODULE_CMD_KEY_OW | REDISMODULE_CMD_KEY_UPDATE,
+        .begin_search_type = REDISMODULE_KSPEC_BS_INDEX,
+        .bs.index.pos = 1,
+        .find_keys_type = REDISMODULE_KSPEC_FK_RANGE,
+        .fk.range = { 0, 1, 0 }
+    },
+    { 0 }
+};
+
+static RedisModuleCommandKeySpec StaleKeySpecs[] = {
+    {
+        .notes = "Deletes tombstones",
+        .flags = REDISMODULE_CMD_KEY_RW | REDISMODULE_CMD_KEY_UPDATE | REDISMODULE_CMD_KEY_DELETE,
+        .begin_search_type = REDISMODULE_KSPEC_BS_INDEX,
+        .bs.index.pos = 1,
+        .find_keys_type = REDISMODULE_KSPEC_FK_RANGE,
+        .fk.range = { -1, 1, 0 }
+    },
+    { 0 }
+};
+
+static const struct {
+    const char *name;
+    RedisModuleCommandInfo info;
+} GuardCommandInfo[] = {
+    { "cache.guard.get", {
+        .version = REDISMODULE_COMMAND_INFO_VERSION,
+        .summary = "Get a cached value, handing one client the regeneration lease",
+        .arity = -2,
+        .key_specs = GetKeySpecs } },
+    { "cache.guard.mget", {
+        .version = REDISMODULE_COMMAND_INFO_VERSION,
+        .summary = "Run cache.guard.get for several keys",
+        .arity = -3,
+        .key_specs = MGetKeySpecs } },
+    { "cache.guard.getrange", {
+        .version = REDISMODULE_COMMAND_INFO_VERSION,
+        .summary = "Read part of a cached value without taking a lease",
+        .arity = 4,
+        .key_specs = GetRangeKeySpecs } },
+    { "cache.guard.set", {
+        .version = REDISMODULE_COMMAND_INFO_VERSION,
+        .summary = "Store a cached value and release its regeneration lease",
+        .arity = -4,
+        .key_specs = SetKeySpecs } },
+    { "cache.guard.mset", {
+        .version = REDISMODULE_COMMAND_INFO_VERSION,
+        .summary = "Store several cached values with one expiry",
+        .arity = -4,
+        .key_specs = MSetKeySpecs } },
+    { "cache.guard.setmissing", {
+        .version = REDISMODULE_COMMAND_INFO_VERSION,
+        .summary = "Cache that a key's entity does not exist",
+        .arity = -3,
+        .key_specs = SetKeySpecs } },
+    { "cache.guard.restore", {
+        .version = REDISMODULE_COMMAND_INFO_VERSION,
+        .summary = "Recreate a guarded entry with an absolute expiry",
+        .arity = -4,
+        .key_specs = RestoreKeySpecs } },
+    { "cache.guard.stale", {
+        .version = REDISMODULE_COMMAND_INFO_VERSION,
+        .summary = "Mark values due for regeneration without deleting them",
+        .arity = -2,
+        .key_specs = StaleKeySpecs } }
+};
+
+// Declares key specs on servers that support them; older servers fall back
+// to the first/last/step key positions given to CreateCommand.
+static int RegisterCommandInfo(RedisModuleCtx *ctx) {
+    if (RedisModule_SetCommandInfo == NULL || RedisModule_GetCommand == NULL) {
+        return REDISMODULE_OK;
+    }
+    for (size_t i = 0; i < sizeof(GuardCommandInfo) / sizeof(GuardCommandInfo[0]); i++) {
+        RedisModuleCommand *cmd = RedisModule_GetCommand(ctx, GuardCommandInfo[i].name);
+        if (!cmd || RedisModule_SetCommandInfo(cmd, &GuardCommandInfo[i].info) == REDISMODULE_ERR) {
+            LOG_WARNING(ctx, "Failed to set command info for %s", GuardCommandInfo[i].name);
+            return REDISMODULE_ERR;
+        }
+    }
+    return REDISMODULE_OK;
+}
+
 // Module initialization with enhanced error handling
 int RedisModule_OnLoad(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
     REDISMODULE_NOT_USED(argv);
@@ -364,28 +4345,161 @@ int RedisModule_OnLoad(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
         return REDISMODULE_ERR;
     }
 
+    // Blocking on keys (cache.guard.get ... WAIT) needs Redis 6.0
+    if (RedisModule_BlockClientOnKeys == NULL || RedisModule_SignalKeyAsReady == NULL) {
+        RedisModule_Log(ctx, REDISMODULE_LOGLEVEL_WARNING,
+                        "CacheGuard: Redis 6.0 or newer is required");
+        return REDISMODULE_ERR;
+    }
+
+    rng_state ^= (uint64_t)RedisModule_Milliseconds() * 0x9E3779B97F4A7C15ULL;
+    if (rng_state == 0) rng_state = 1;
+    grace_prefixes = RedisModule_CreateDict(NULL);
+    bloom_filters = RedisModule_CreateDict(NULL);
+    regen_queue.jobs = RedisModule_CreateDict(NULL);
+    tag_index = RedisModule_CreateDict(NULL);
+    tagged_keys = RedisModule_CreateDict(NULL);
+    namespaces = RedisModule_CreateDict(NULL);
+    hotkeys.last_decay = RedisModule_Milliseconds();
+
+    RedisModuleTypeMethods typeMethods = {
+        .version = REDISMODULE_TYPE_METHOD_VERSION,
+        .rdb_load = CacheGuardTypeRdbLoad,
+        .rdb_save = CacheGuardTypeRdbSave,
+        .aof_rewrite = CacheGuardTypeAofRewrite,
+        .mem_usage = CacheGuardTypeMemUsage,
+        .digest = CacheGuardTypeDigest,
+        .free = CacheGuardEntryFree
+    };
+
+    CacheGuardType = RedisModule_CreateDataType(ctx, CACHEGUARD_TYPE_NAME,
+                                                CACHEGUARD_TYPE_ENCVER, &typeMethods);
+    if (CacheGuardType == NULL) {
+        return REDISMODULE_ERR;
+    }
+
+    if (RedisModule_RegisterInfoFunc(ctx, CacheGuardInfoFunc) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
     // Register main commands
     if (RedisModule_CreateCommand(ctx, "cache.guard.get", CacheGuardGetCommand, 
                                  "write fast", 1, 1, 1) == REDISMODULE_ERR) {
         return REDISMODULE_ERR;
     }
 
+    if (RedisModule_CreateCommand(ctx, "cache.guard.mget", CacheGuardMGetCommand, 
+                                 "write", 2, -1, 1) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    if (RedisModule_CreateCommand(ctx, "cache.guard.getrange", CacheGuardGetRangeCommand, 
+                                 "readonly", 1, 1, 1) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
     if (RedisModule_CreateCommand(ctx, "cache.guard.set", CacheGuardSetCommand, 
                                  "write", 1, 1, 1) == REDISMODULE_ERR) {
         return REDISMODULE_ERR;
     }
     
+    if (RedisModule_CreateCommand(ctx, "cache.guard.mset", CacheGuardMSetCommand, 
+                                 "write getkeys-api", 2, -1, 2) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    if (RedisModule_CreateCommand(ctx, "cache.guard.setmissing", CacheGuardSetMissingCommand, 
+                                 "write", 1, 1, 1) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    if (RedisModule_CreateCommand(ctx, "cache.guard.restore", CacheGuardRestoreCommand, 
+                                 "write deny-oom", 1, 1, 1) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    if (RedisModule_CreateCommand(ctx, "cache.guard.stale", CacheGuardStaleCommand, 
+                                 "write", 1, -1, 1) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    if (RedisModule_CreateCommand(ctx, "cache.guard.ns.bump", CacheGuardNsBumpCommand, 
+                                 "write fast", 0, 0, 0) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    if (RedisModule_CreateCommand(ctx, "cache.guard.claim", CacheGuardClaimCommand, 
+                                 "write deny-oom", 0, 0, 0) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    if (RedisModule_CreateCommand(ctx, "cache.guard.invalidate", CacheGuardInvalidateCommand, 
+                                 "write", 0, 0, 0) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+    
     // Register utility commands
     if (RedisModule_CreateCommand(ctx, "cache.guard.info", CacheGuardInfoCommand, 
                                  "readonly fast", 0, 0, 0) == REDISMODULE_ERR) {
         return REDISMODULE_ERR;
     }
     
+    if (RedisModule_CreateCommand(ctx, "cache.guard.latency", CacheGuardLatencyCommand, 
+                                 "readonly fast", 0, 0, 0) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    if (RedisModule_CreateCommand(ctx, "cache.guard.hotkeys", CacheGuardHotKeysCommand, 
+                                 "readonly fast", 0, 0, 0) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    // Clearing the statistics is admin, like LATENCY RESET: granting the
+    // reads above doesn't grant wiping them. Not write, so that replicas can
+    // reset their own.
+    if (RedisModule_CreateCommand(ctx, "cache.guard.latency.reset", CacheGuardLatencyResetCommand, 
+                                 "admin fast", 0, 0, 0) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    if (RedisModule_CreateCommand(ctx, "cache.guard.hotkeys.reset", CacheGuardHotKeysResetCommand, 
+                                 "admin fast", 0, 0, 0) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    if (RedisModule_CreateCommand(ctx, "cache.guard.grace", CacheGuardGraceCommand, 
+                                 "readonly fast", 0, 0, 0) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    if (RedisModule_CreateCommand(ctx, "cache.guard.bloom", CacheGuardBloomCommand, 
+                                 "write deny-oom", 0, 0, 0) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
     if (RedisModule_CreateCommand(ctx, "cache.guard.config", CacheGuardConfigCommand, 
                                  "write", 0, 0, 0) == REDISMODULE_ERR) {
         return REDISMODULE_ERR;
     }
 
+    if (RegisterCommandInfo(ctx) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    // Keeps the tag index in step with deletes, expiry, eviction and writes
+    // by other commands. Beyond generic and string events, only the list, set
+    // and sorted set classes can replace a key of another type (SORT ... STORE,
+    // SUNIONSTORE, ZUNIONSTORE and the like); hash and stream writes can't.
+    int notifyTypes = REDISMODULE_NOTIFY_GENERIC | REDISMODULE_NOTIFY_STRING |
+                      REDISMODULE_NOTIFY_LIST | REDISMODULE_NOTIFY_SET | REDISMODULE_NOTIFY_ZSET |
+                      REDISMODULE_NOTIFY_EXPIRED | REDISMODULE_NOTIFY_EVICTED |
+                      REDISMODULE_NOTIFY_MODULE;
+    if (RedisModule_SubscribeToKeyspaceEvents(ctx, notifyTypes, TagIndexNotify) == REDISMODULE_ERR ||
+        RedisModule_SubscribeToServerEvent(ctx, RedisModuleEvent_FlushDB, TagIndexFlushed) == REDISMODULE_ERR ||
+        RedisModule_SubscribeToServerEvent(ctx, RedisModuleEvent_SwapDB, TagIndexSwapped) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
     LOG_NOTICE(ctx, "Cache Guard module loaded successfully (version %s)", MODULE_VERSION);
     return REDISMODULE_OK;
 } 
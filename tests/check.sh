@@ -0,0 +1,255 @@
+#!/bin/sh
+# Behavior suite for `make check`: drives a running server that has the
+# module loaded through redis-cli and compares the replies.
+#
+#   check.sh <port>
+#
+# redis-cli prints replies without type markers when its output is not a
+# terminal: one line per element of an array (nested arrays flattened), an
+# empty line for null, and errors as their message. Each section uses its
+# own key prefix, so sections don't see each other's keys.
+
+REDIS_CLI=${REDIS_CLI:-redis-cli}
+port=${1:?usage: $0 <port>}
+failures=0
+checks=0
+
+cli() {
+    "$REDIS_CLI" -p "$port" "$@" 2>&1
+}
+
+# check <what> <expected> <got>
+check() {
+    checks=$((checks + 1))
+    if [ "$3" != "$2" ]; then
+        failures=$((failures + 1))
+        printf 'FAIL: %.200s\n  expected: %.200s\n  got:      %.200s\n' "$1" "$2" "$3"
+    fi
+}
+
+# expect <reply> <command ...>: the whole reply must match
+expect() {
+    want=$1
+    shift
+    check "$*" "$want" "$(cli "$@")"
+}
+
+# expect_prefix <prefix> <command ...>: the reply must start with prefix
+expect_prefix() {
+    want=$1
+    shift
+    got=$(cli "$@")
+    checks=$((checks + 1))
+    case "$got" in
+    "$want"*) ;;
+    *)
+        failures=$((failures + 1))
+        printf 'FAIL: %.200s\n  expected: %.200s...\n  got:      %.200s\n' "$*" "$want" "$got"
+        ;;
+    esac
+}
+
+# line <n> <text>: the nth line of a reply
+line() {
+    echo "$2" | sed -n "$1p"
+}
+
+# The second line of a WITHSTATUS reply: the value, token or retry time
+payload() {
+    line 2 "$(cli "$@")"
+}
+
+# stdin <command line>: sends one line on stdin, so redis-cli unquotes "\xNN"
+# escapes and binary payloads can be written
+stdin() {
+    printf '%s\n' "$1" | "$REDIS_CLI" -p "$port" 2>&1
+}
+
+# hexhead <n> <command ...>: the first n bytes of a reply in hex
+hexhead() {
+    n=$1
+    shift
+    cli "$@" | dd bs=1 count="$n" 2>/dev/null | od -An -tx1 | tr -d ' \n'
+}
+
+nl='
+'
+
+# --- Basics: a write, a fresh read, errors
+expect OK cache.guard.set check:key ok 60000
+expect ok cache.guard.get check:key 1000
+expect "fresh${nl}ok" cache.guard.get check:key 1000 WITHSTATUS
+expect miss cache.guard.get check:none 1000 WITHSTATUS
+expect "ERR expire time must be between 1 second and 7 days" cache.guard.set check:key ok 10
+expect_prefix "ERR wrong number of arguments" cache.guard.set check:key
+
+# --- Grace window: one reader regenerates, the others get the old value
+expect OK cache.guard.set grace:a v1 10000
+expect_prefix "regen${nl}" cache.guard.get grace:a 20000 WITHSTATUS
+expect "stale${nl}v1" cache.guard.get grace:a 20000 WITHSTATUS
+expect v1 cache.guard.get grace:a 20000
+
+# --- Fencing: a write with a superseded token is rejected
+expect OK cache.guard.set fence:a v1 10000
+token=$(payload cache.guard.get fence:a 20000 WITHSTATUS)
+expect 1 cache.guard.stale fence:a
+expect "STALETOKEN write rejected, a newer lease token was issued" \
+    cache.guard.set fence:a late 10000 TOKEN "$token"
+token=$(payload cache.guard.get fence:a 20000 WITHSTATUS)
+expect OK cache.guard.set fence:a v2 10000 TOKEN "$token"
+expect OK cache.guard.set fence:a v3 10000 TOKEN "$token"
+expect OK cache.guard.set fence:a v4 10000
+expect "STALETOKEN write rejected, a newer lease token was issued" \
+    cache.guard.set fence:a v5 10000 TOKEN "$token"
+expect v4 cache.guard.get fence:a 1000
+expect "ERR invalid token" cache.guard.set fence:a v 10000 TOKEN 0
+
+# --- Lock on miss: the first reader regenerates, the others are told to retry
+expect "" cache.guard.get lockmiss:a 1000 LOCKMISS
+expect_prefix "BUSYREGEN key is being regenerated, retry after" \
+    cache.guard.get lockmiss:a 1000 LOCKMISS
+expect miss cache.guard.mget 1000 lockmiss:a
+expect "" cache.guard.get lockmiss:a 1000
+expect OK cache.guard.set lockmiss:a built 10000
+expect built cache.guard.get lockmiss:a 1000 LOCKMISS
+
+# --- WAIT: waiters wake on the write, or get null at the timeout
+out=${TMPDIR:-/tmp}/cacheguard-check-$port.out
+expect "" cache.guard.get wait:a 1000 LOCKMISS
+cli cache.guard.get wait:a 1000 WAIT 5000 >"$out" &
+waiter=$!
+sleep 0.3
+expect OK cache.guard.set wait:a hello 10000
+wait $waiter
+check "WAIT wakeup" hello "$(cat "$out")"
+expect "" cache.guard.get wait:b 1000 LOCKMISS
+expect "" cache.guard.get wait:b 1000 WAIT 300
+expect "ERR wait timeout must be between 1ms and 24 hours" cache.guard.get wait:b 1000 WAIT 0
+rm -f "$out"
+
+# --- mset: every pair written, or none
+expect OK cache.guard.mset 60000 mset:a 1 mset:b 2
+expect "fresh${nl}1${nl}fresh${nl}2${nl}miss" cache.guard.mget 1000 mset:a mset:b mset:c
+expect "ERR empty key not allowed" cache.guard.mset 60000 mset:c 3 "" 4
+expect 0 exists mset:c
+expect OK cache.guard.mset 60000 JITTER 10 mset:d 4
+expect 4 cache.guard.get mset:d 1000
+
+# --- Tombstones: known-missing entities
+expect OK cache.guard.setmissing missing:a 60000
+expect "MISSING key is known not to exist" cache.guard.get missing:a 1000
+expect missing cache.guard.get missing:a 1000 WITHSTATUS
+expect "ERR expire time must be between 1 second and 7 days" cache.guard.setmissing missing:a 10
+expect OK cache.guard.set missing:a found 60000
+expect found cache.guard.get missing:a 1000
+token=$(payload cache.guard.get missing:b 1000 LOCKMISS WITHSTATUS)
+expect OK cache.guard.setmissing missing:b 60000 TOKEN "$token"
+expect "MISSING key is known not to exist" cache.guard.get missing:b 1000
+
+# --- Tag invalidation: delete, or mark stale with SOFT
+expect OK cache.guard.set tag:a 1 60000 TAGS t:1
+expect OK cache.guard.set tag:b 2 60000 TAGS t:1 t:2
+expect OK cache.guard.set tag:c 3 60000 TAGS t:2
+expect 2 cache.guard.invalidate TAG t:1
+expect 0 exists tag:a tag:b
+expect 1 cache.guard.invalidate TAG t:2 SOFT
+expect_prefix "regen${nl}" cache.guard.get tag:c 1000 WITHSTATUS
+expect "stale${nl}3" cache.guard.get tag:c 1000 WITHSTATUS
+expect 0 cache.guard.invalidate TAG t:none
+
+# --- Namespace invalidation: soft bumps mark stale, HARD ones delete on read
+expect OK cache.guard.set ns:1:a 1 60000
+expect OK cache.guard.set ns:2:a 2 60000
+expect OK cache.guard.set ns:3:a 3 60000
+expect 1 cache.guard.ns.bump ns:1
+expect_prefix "regen${nl}" cache.guard.get ns:1:a 1000 WITHSTATUS
+expect "stale${nl}1" cache.guard.get ns:1:a 1000 WITHSTATUS
+expect 1 cache.guard.ns.bump ns:2 HARD
+expect miss cache.guard.get ns:2:a 1000 WITHSTATUS
+expect 0 exists ns:2:a
+expect "fresh${nl}3" cache.guard.get ns:3:a 1000 WITHSTATUS
+expect OK cache.guard.set ns:1:a 11 60000
+expect "fresh${nl}11" cache.guard.get ns:1:a 1000 WITHSTATUS
+
+# --- Stale marking: the value stays until the rebuild is written
+expect OK cache.guard.set stale:a old 60000
+expect OK cache.guard.setmissing stale:m 60000
+expect 2 cache.guard.stale stale:a stale:m stale:none
+expect 0 exists stale:m
+token=$(payload cache.guard.get stale:a 1000 WITHSTATUS)
+expect "stale${nl}old" cache.guard.get stale:a 1000 WITHSTATUS
+expect OK cache.guard.set stale:a new 60000 TOKEN "$token"
+expect "fresh${nl}new" cache.guard.get stale:a 1000 WITHSTATUS
+
+# --- Regeneration queue: claim, requeue after the lease, complete
+expect_prefix "BUSYREGEN key is being regenerated" cache.guard.get queue:a 1000 QUEUE
+expect_prefix "busy${nl}" cache.guard.get queue:a 1000 QUEUE WITHSTATUS
+claim=$(cli cache.guard.claim COUNT 10 LEASE 200)
+check "claimed key" queue:a "$(line 1 "$claim")"
+check "claimed lease" 200 "$(line 3 "$claim")"
+first=$(line 2 "$claim")
+expect "" cache.guard.claim
+sleep 0.5
+claim=$(cli cache.guard.claim LEASE 2000)
+check "requeued key" queue:a "$(line 1 "$claim")"
+second=$(line 2 "$claim")
+expect "STALETOKEN write rejected, a newer lease token was issued" \
+    cache.guard.set queue:a late 60000 TOKEN "$first"
+expect OK cache.guard.set queue:a built 60000 TOKEN "$second"
+expect built cache.guard.get queue:a 1000 QUEUE
+expect "" cache.guard.claim
+expect "ERR count must be between 1 and 1000" cache.guard.claim COUNT 0
+
+# --- LZ4: values round-trip compressed, chunk by chunk, and bad payloads are
+# refused. big spans four 64KB chunks; noise is hex digits LZ4 can't shrink.
+expect OK cache.guard.config SET compress_threshold 1024
+big=$(awk 'BEGIN { for (i = 0; i < 20000; i++) printf "item%05d,", i }')
+noise=$(dd if=/dev/urandom bs=1024 count=2 2>/dev/null | od -An -tx1 | tr -d ' \n')
+# A single argument is capped at 128KB by the kernel, so big goes on stdin
+check "set big" OK "$(stdin "cache.guard.set lz4:big $big 60000")"
+expect OK cache.guard.set lz4:noise "$noise" 60000
+expect OK cache.guard.set lz4:small short 60000
+check "compressed value" "$big" "$(cli cache.guard.get lz4:big 1000)"
+check "incompressible value" "$noise" "$(cli cache.guard.get lz4:noise 1000)"
+expect short cache.guard.get lz4:small 1000
+check "RAW compressed" 004c5a43 "$(hexhead 4 cache.guard.get lz4:big 1000 RAW)"
+check "RAW incompressible" "$noise" "$(cli cache.guard.get lz4:noise 1000 RAW)"
+check "CHUNKED" "$big" "$(cli cache.guard.get lz4:big 1000 CHUNKED | tr -d '\n')"
+check "mget compressed" "fresh${nl}$big" "$(cli cache.guard.mget 1000 lz4:big)"
+# 65530..65541 and 131070..131081 straddle the first two chunk boundaries
+check "getrange chunk 1/2" "$(printf '%s' "$big" | cut -c65531-65542)" \
+    "$(cli cache.guard.getrange lz4:big 65530 12)"
+check "getrange chunks 1-3" "$(printf '%s' "$big" | cut -c65531-131082)" \
+    "$(cli cache.guard.getrange lz4:big 65530 65552)"
+check "getrange tail" "$(printf '%s' "$big" | cut -c199991-)" \
+    "$(cli cache.guard.getrange lz4:big 199990 100)"
+expect "" cache.guard.getrange lz4:big 300000 10
+# Payloads written by older versions: one "\0LZ4" block for the whole value.
+# This one is the literals "abc", a 9-byte match at offset 3, then "defgh".
+at=$(($(date +%s) * 1000 + 60000))
+check "restore single block" OK \
+    "$(stdin "cache.guard.restore lz4:single $at \"\\x00LZ4\\x11\\x00\\x00\\x00\\x35abc\\x03\\x00\\x50defgh\" LZ4")"
+expect abcabcabcabcdefgh cache.guard.get lz4:single 1000
+expect bcabcabcab cache.guard.getrange lz4:single 1 10
+# A chunk header promising more bytes than follow
+check "restore truncated chunk" "ERR invalid compressed value" \
+    "$(stdin "cache.guard.restore lz4:bad $at \"\\x00LZC\\x11\\x00\\x00\\x00\\x10\\x00\\x00\\x00ab\" LZ4")"
+check "restore short header" "ERR invalid compressed value" \
+    "$(stdin "cache.guard.restore lz4:bad $at \"\\x00LZ4\" LZ4")"
+expect "ERR invalid compressed value" cache.guard.restore lz4:bad "$at" plain LZ4
+expect 0 exists lz4:bad
+# Well framed, but the match points before the start: restore checks the
+# framing only, reads fail cleanly
+check "restore corrupt block" OK \
+    "$(stdin "cache.guard.restore lz4:bad $at \"\\x00LZ4\\x08\\x00\\x00\\x00\\x14a\\x09\\x00\" LZ4")"
+expect "ERR failed to decompress value" cache.guard.get lz4:bad 1000
+expect "ERR failed to decompress value" cache.guard.getrange lz4:bad 0 4
+expect PONG ping
+expect OK cache.guard.config SET compress_threshold 0
+
+if [ $failures -eq 0 ]; then
+    echo "check: $checks checks passed"
+    exit 0
+fi
+echo "check: $failures of $checks checks failed"
+exit 1